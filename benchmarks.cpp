@@ -0,0 +1,423 @@
+#include <string>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define HAS_TSC 1
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "crc.h"
+#include "adler32.h"
+#include "deflate.h"
+#include "file_io.h"
+
+using namespace deflate;
+
+// Benchmarks of inflate, deflate and the checksums on a generated corpus, so results are comparable between machines
+// and releases, plus any files given on the command line.
+//
+// Usage: deflate_benchmarks [--json] [--cpu N] [--min-time SECONDS] [--filter TEXT] [file...]
+//
+// Every benchmark runs once to warm up and then repeatedly for at least the minimum time (and at least 5 times). The
+// median run is reported as MB/s of uncompressed data and, on x86, time stamp counter cycles per byte (TSC cycles
+// run at the nominal frequency, so they only match core cycles without frequency scaling).
+
+struct corpus_entry {
+    std::string          name;
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> compressed;   // Raw deflate stream of data
+    bool                 inflate_only; // Only the compressed form differs from another entry
+};
+
+// Deterministic on every platform, unlike rand()
+class xorshift {
+public:
+    uint32_t next() {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 7;
+        state_ ^= state_ << 17;
+        return static_cast<uint32_t>(state_ >> 32);
+    }
+
+    // Zipf distributed (probability of k proportional to 1/(k+1)) in [0, n)
+    int zipf(int n) {
+        const auto u = (next() & 0xffffff) / 16777216.0;
+        return std::min(n - 1, static_cast<int>(pow(n + 1.0, u)) - 1);
+    }
+
+private:
+    uint64_t state_ = 0x9e3779b97f4a7c15;
+};
+
+constexpr size_t corpus_size = 2 << 20;
+
+// Text with a Zipf distributed vocabulary of made up words (the common ones shortest), like natural language
+std::vector<uint8_t> make_text()
+{
+    static const char* const syllables[] = {
+        "a", "an", "ar", "be", "bi", "ca", "co", "de", "di", "e", "el", "en", "er", "fo", "ga", "he", "hi", "i", "in",
+        "is", "la", "le", "li", "lo", "ma", "me", "mi", "mo", "na", "ne", "no", "o", "on", "or", "pa", "pe", "ra",
+        "re", "ri", "ro", "sa", "se", "so", "st", "ta", "te", "th", "ti", "to", "u", "un", "ur", "va", "ve", "wa",
+    };
+    constexpr int num_syllables = sizeof(syllables) / sizeof(*syllables);
+    constexpr int num_words     = 5000;
+    xorshift rng;
+    std::vector<std::string> words(num_words);
+    for (int i = 0; i < num_words; ++i) {
+        const int n = 1 + (i >= 30) + (i >= 300) + (i >= 2000) + rng.next() % 2;
+        for (int j = 0; j < n; ++j) {
+            words[i] += syllables[rng.next() % num_syllables];
+        }
+    }
+    std::string text;
+    bool capitalize = true;
+    while (text.size() < corpus_size) {
+        std::string word = words[rng.zipf(num_words)];
+        if (capitalize) {
+            word[0] = static_cast<char>(word[0] - 'a' + 'A');
+        }
+        text += word;
+        const auto r = rng.next() % 100;
+        capitalize = r < 8;
+        text += r < 6 ? ". " : r < 8 ? ".\n" : r < 14 ? ", " : " ";
+    }
+    text.resize(corpus_size);
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+// Table of fixed size little endian records, like a database page or an object file
+std::vector<uint8_t> make_binary()
+{
+    static const char names[4][8] = { "alpha", "beta", "gamma", "delta" };
+    xorshift rng;
+    std::vector<uint8_t> data;
+    for (uint32_t id = 0; data.size() < corpus_size; ++id) {
+        const uint32_t fields[4] = { id, rng.next() % 16, 1000000 + id * 17 + rng.next() % 100, rng.next() };
+        for (auto f : fields) {
+            for (int i = 0; i < 4; ++i) {
+                data.push_back(static_cast<uint8_t>(f >> (8 * i)));
+            }
+        }
+        const auto& name = names[rng.zipf(4)];
+        data.insert(data.end(), name, name + 8);
+    }
+    data.resize(corpus_size);
+    return data;
+}
+
+// Runs and short repeating patterns, like bitmaps: almost only matches at distances below 16
+std::vector<uint8_t> make_short_distances()
+{
+    xorshift rng;
+    std::vector<uint8_t> data;
+    while (data.size() < corpus_size) {
+        const auto period = 1 + rng.next() % 8;
+        const auto length = 20 + rng.next() % 300;
+        uint8_t pattern[8];
+        for (auto& p : pattern) {
+            p = static_cast<uint8_t>(rng.next());
+        }
+        for (uint32_t i = 0; i < length; ++i) {
+            data.push_back(pattern[i % period]);
+        }
+    }
+    data.resize(corpus_size);
+    return data;
+}
+
+// Base64 of random bytes in 76 character lines, like e-mail attachments: almost only literals with short codes
+std::vector<uint8_t> make_literals()
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    xorshift rng;
+    std::vector<uint8_t> data;
+    while (data.size() < corpus_size) {
+        for (int i = 0; i < 76; ++i) {
+            data.push_back(alphabet[rng.next() % 64]);
+        }
+        data.push_back('\n');
+    }
+    data.resize(corpus_size);
+    return data;
+}
+
+// Deflate data split by sync flushes into tiny blocks, each with its own (dynamic) Huffman tables
+std::vector<uint8_t> compress_in_small_blocks(const std::vector<uint8_t>& data)
+{
+    constexpr size_t block_size = 1024;
+    deflater d;
+    std::vector<uint8_t> compressed;
+    for (size_t pos = 0; pos < data.size(); pos += block_size) {
+        const auto end = std::min(data.size(), pos + block_size);
+        d.compress(data.data(), data.data() + pos, data.data() + end, end == data.size(), compressed);
+    }
+    return compressed;
+}
+
+corpus_entry make_entry(const std::string& name, std::vector<uint8_t> data)
+{
+    auto compressed = compress(stream_format::raw, data.data(), data.data() + data.size());
+    return corpus_entry{name, std::move(data), std::move(compressed), false};
+}
+
+std::vector<corpus_entry> make_corpus()
+{
+    std::vector<corpus_entry> corpus;
+    corpus.push_back(make_entry("text", make_text()));
+    corpus.push_back(make_entry("binary", make_binary()));
+    // Already compressed data is (nearly) incompressible, mostly written as stored blocks
+    corpus.push_back(make_entry("compressed", corpus[0].compressed));
+    corpus.push_back(make_entry("short_distances", make_short_distances()));
+    corpus.push_back(make_entry("literals", make_literals()));
+    auto small_blocks = corpus[0];
+    small_blocks.name       = "small_blocks";
+    small_blocks.compressed   = compress_in_small_blocks(small_blocks.data);
+    small_blocks.inflate_only = true;
+    corpus.push_back(std::move(small_blocks));
+    return corpus;
+}
+
+struct result {
+    std::string benchmark;
+    std::string input;
+    size_t      bytes;
+    size_t      output_bytes; // Compressed size for inflate and deflate, otherwise 0
+    int         runs;
+    double      median_ms;
+    double      min_ms;
+    double      cycles_per_byte; // Negative without a cycle counter
+};
+
+// Keeps the checksum calculations from being optimized away
+volatile uint32_t checksum_sink;
+
+uint64_t read_cycle_counter()
+{
+#ifdef HAS_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Time f, which returns the size of its output, on input of bytes bytes
+result run_benchmark(const std::string& benchmark, const std::string& input, size_t bytes, double min_time, const std::function<size_t()>& f)
+{
+    const size_t output_bytes = f(); // Warm up
+    struct sample {
+        double   ms;
+        uint64_t cycles;
+    };
+    std::vector<sample> samples;
+    double total = 0;
+    while (samples.size() < 5 || total < min_time * 1000) {
+        const auto start_cycles = read_cycle_counter();
+        const auto start        = std::chrono::steady_clock::now();
+        f();
+        const auto end          = std::chrono::steady_clock::now();
+        const auto end_cycles   = read_cycle_counter();
+        samples.push_back({std::chrono::duration<double, std::milli>(end - start).count(), end_cycles - start_cycles});
+        total += samples.back().ms;
+    }
+    std::sort(samples.begin(), samples.end(), [](const sample& l, const sample& r) { return l.ms < r.ms; });
+    const auto& median = samples[samples.size() / 2];
+#ifdef HAS_TSC
+    const double cycles_per_byte = static_cast<double>(median.cycles) / bytes;
+#else
+    const double cycles_per_byte = -1;
+#endif
+    return result{benchmark, input, bytes, output_bytes, static_cast<int>(samples.size()), median.ms, samples[0].ms, cycles_per_byte};
+}
+
+double mb_per_s(const result& r)
+{
+    return r.bytes / (r.median_ms * 1000.0);
+}
+
+void print_table_header()
+{
+    std::cout << std::left << std::setw(12) << "benchmark" << std::setw(18) << "input" << std::right << std::setw(10) << "MB/s"
+              << std::setw(12) << "cycles/B" << std::setw(12) << "median ms" << std::setw(10) << "min ms" << std::setw(8) << "ratio" << "\n";
+}
+
+void print_table_row(const result& r)
+{
+    std::cout << std::left << std::setw(12) << r.benchmark << std::setw(18) << r.input << std::right << std::fixed
+              << std::setprecision(1) << std::setw(10) << mb_per_s(r) << std::setprecision(2) << std::setw(12);
+    if (r.cycles_per_byte >= 0) {
+        std::cout << r.cycles_per_byte;
+    } else {
+        std::cout << "-";
+    }
+    std::cout << std::setprecision(3) << std::setw(12) << r.median_ms << std::setw(10) << r.min_ms << std::setw(8);
+    if (r.output_bytes) {
+        std::cout << static_cast<double>(r.output_bytes) / r.bytes;
+    } else {
+        std::cout << "-";
+    }
+    std::cout << std::endl;
+}
+
+std::string json_string(const std::string& s)
+{
+    std::ostringstream out;
+    out << '"';
+    for (const char c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+void print_json(const std::vector<result>& results)
+{
+    std::cout << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        std::cout << "  {\"benchmark\": " << json_string(r.benchmark) << ", \"input\": " << json_string(r.input)
+                  << ", \"bytes\": " << r.bytes << ", \"output_bytes\": " << r.output_bytes << ", \"runs\": " << r.runs
+                  << std::setprecision(6) << ", \"median_ms\": " << r.median_ms << ", \"min_ms\": " << r.min_ms
+                  << ", \"mb_per_s\": " << mb_per_s(r) << ", \"cycles_per_byte\": ";
+        if (r.cycles_per_byte >= 0) {
+            std::cout << r.cycles_per_byte;
+        } else {
+            std::cout << "null";
+        }
+        std::cout << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    std::cout << "]" << std::endl;
+}
+
+// Run on a single CPU so the scheduler doesn't migrate the benchmark, returns false if that isn't possible
+bool pin_to_cpu(int cpu)
+{
+#ifdef __linux__
+    if (cpu < 0) {
+        cpu = sched_getcpu();
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return cpu >= 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+std::string base_name(const std::string& path)
+{
+    const auto slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+int main(int argc, char* argv[])
+{
+    try {
+        bool        json     = false;
+        int         cpu      = -1;
+        double      min_time = 0.5;
+        std::string filter;
+        std::vector<std::string> files;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--json") {
+                json = true;
+            } else if ((arg == "--cpu" || arg == "--min-time" || arg == "--filter") && i + 1 < argc) {
+                const std::string value = argv[++i];
+                if (arg == "--cpu") {
+                    cpu = atoi(value.c_str());
+                } else if (arg == "--min-time") {
+                    min_time = atof(value.c_str());
+                } else {
+                    filter = value;
+                }
+            } else if (arg.size() > 1 && arg[0] == '-') {
+                std::cerr << "Usage: " << argv[0] << " [--json] [--cpu N] [--min-time SECONDS] [--filter TEXT] [file...]\n";
+                return 2;
+            } else {
+                files.push_back(arg);
+            }
+        }
+
+#ifndef NDEBUG
+        std::cerr << "Warning: assertions are enabled, configure with -DCMAKE_BUILD_TYPE=Release\n";
+#endif
+        if (!pin_to_cpu(cpu)) {
+            std::cerr << "Warning: not pinned to a CPU\n";
+        }
+
+        auto corpus = make_corpus();
+        for (const auto& filename : files) {
+            const mapped_file file{filename};
+            corpus.push_back(make_entry(base_name(filename), std::vector<uint8_t>(file.begin(), file.end())));
+        }
+
+        std::vector<result> results;
+        auto run = [&](const std::string& benchmark, const corpus_entry& e, const std::function<size_t()>& f) {
+            if (!filter.empty() && (benchmark + "/" + e.name).find(filter) == std::string::npos) {
+                return;
+            }
+            results.push_back(run_benchmark(benchmark, e.name, e.data.size(), min_time, f));
+            if (!json) {
+                print_table_row(results.back());
+            }
+        };
+
+        if (!json) {
+            print_table_header();
+        }
+        for (const auto& e : corpus) {
+            const auto begin = e.data.data(), end = e.data.data() + e.data.size();
+            std::vector<uint8_t> output;
+            inflater inf;
+            decompress(inf, e.compressed.data(), e.compressed.data() + e.compressed.size(), output);
+            if (output != e.data) {
+                throw std::runtime_error(e.name + ": inflate output mismatch");
+            }
+            run("inflate", e, [&] {
+                decompress(inf, e.compressed.data(), e.compressed.data() + e.compressed.size(), output);
+                return e.compressed.size();
+            });
+            if (e.inflate_only) {
+                continue;
+            }
+            run("crc32", e, [&] { checksum_sink = update_crc32(0, begin, end); return size_t{0}; });
+            run("adler32", e, [&] { checksum_sink = update_adler32(1, begin, end); return size_t{0}; });
+            for (int level : { 1, 6, 9 }) {
+                run("deflate-" + std::to_string(level), e, [&] {
+                    return compress(stream_format::raw, begin, end, level).size();
+                });
+            }
+        }
+        if (json) {
+            print_json(results);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
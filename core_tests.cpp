@@ -2,12 +2,27 @@
 #include <iostream>
 #include <algorithm>
 #include <stdlib.h>
+#include <stdio.h>
 
 #include "crc.h"
+#include "adler32.h"
+#include "batch_inflate.h"
 #include "bit_stream.h"
+#include "bit_writer.h"
+#include "code_lengths.h"
 #include "huffman_tree.h"
 #include "huffman_table.h"
+#include "inflate_stats.h"
+#include "decode_table.h"
 #include "deflate.h"
+#include "deflate_error.h"
+#include "file_io.h"
+#include "gzip_index.h"
+#include "inflater.h"
+#include "output_buffer.h"
+#include "parallel_deflate.h"
+#include "parallel_inflate.h"
+#include "speculative_inflate.h"
 
 #define CHECK(expr) do { if (!(expr)) { std::cerr << #expr << std::endl; abort(); } } while (false)
 
@@ -17,6 +32,40 @@ void test_crc32()
 {
     const uint8_t d[14] = { 'L', 'i', 'n', 'e', ' ', '1', '\n', 'L', 'i', 'n', 'e', ' ', '2', '\n'};
     CHECK(0x87E4F545 == update_crc32(0, d, d+sizeof(d)));
+
+    // Lengths, alignments and split points exercising the wide paths against a bitwise reference
+    auto reference_crc32 = [](const uint8_t* beg, const uint8_t* end) {
+        uint32_t crc = ~0U;
+        for (auto p = beg; p != end; ++p) {
+            crc ^= *p;
+            for (int i = 0; i < 8; ++i) crc = crc & 1 ? 0xedb88320 ^ (crc >> 1) : crc >> 1;
+        }
+        return ~crc;
+    };
+    std::vector<uint8_t> data(1024 + 16);
+    for (int i = 0; i < (int)data.size(); ++i) data[i] = static_cast<uint8_t>(i * 7 + (i >> 5));
+    for (int offset = 0; offset < 16; offset += 3) {
+        for (int len = 0; len <= 1024; len += len < 200 ? 1 : 37) {
+            const auto beg = data.data() + offset;
+            const auto expected = reference_crc32(beg, beg + len);
+            CHECK(update_crc32(0, beg, beg + len) == expected);
+            CHECK(update_crc32(update_crc32(0, beg, beg + len / 3), beg + len / 3, beg + len) == expected);
+            CHECK(combine_crc32(update_crc32(0, beg, beg + len / 3), update_crc32(0, beg + len / 3, beg + len), len - len / 3) == expected);
+        }
+    }
+    CHECK(combine_crc32(0x12345678, 0, 0) == 0x12345678);
+}
+
+void test_adler32()
+{
+    const uint8_t d[9] = { 'W', 'i', 'k', 'i', 'p', 'e', 'd', 'i', 'a' };
+    CHECK(0x11E60398 == update_adler32(1, d, d+sizeof(d)));
+    // Sums must be reduced before they overflow
+    const std::vector<uint8_t> ff(100000, 0xff);
+    uint32_t s1 = 1, s2 = 0;
+    for (auto b : ff) { s1 = (s1 + b) % 65521; s2 = (s2 + s1) % 65521; }
+    CHECK(((s2 << 16) | s1) == update_adler32(1, ff.data(), ff.data() + ff.size()));
+    CHECK(((s2 << 16) | s1) == update_adler32(update_adler32(1, ff.data(), ff.data() + 777), ff.data() + 777, ff.data() + ff.size()));
 }
 
 void test_bit_stream()
@@ -62,6 +111,44 @@ void test_bit_stream()
         CHECK(bs.get_bit() == 1);
         CHECK(bs.get_bit() == 0);
     }
+    {
+        // Bulk refills and the byte-wise refill near the end of the input
+        uint8_t long_data[19];
+        for (int i = 0; i < (int)sizeof(long_data); ++i) long_data[i] = static_cast<uint8_t>(i * 0x25 + 1);
+        for (int n = 1; n <= 16; ++n) {
+            bit_stream bs{long_data};
+            uint64_t expected = 0, expected_bits = 0;
+            int pos = 0;
+            for (int i = 0; i < 8 * (int)sizeof(long_data) / n; ++i) {
+                while (expected_bits < (uint64_t)n) {
+                    expected |= static_cast<uint64_t>(long_data[pos++]) << expected_bits;
+                    expected_bits += 8;
+                }
+                bs.ensure_bits(bit_stream::max_ensure_bits);
+                CHECK(bs.get_bits(n) == (expected & ((1 << n) - 1)));
+                expected >>= n;
+                expected_bits -= n;
+            }
+            CHECK(!bs.overrun());
+        }
+    }
+    {
+        // Reading past the end and continuing with more input
+        const uint8_t more[] = { 0x3c };
+        bit_stream bs{data};
+        CHECK(bs.get_bits(12) == 0x55a);
+        bs.ensure_bits(16);
+        CHECK(!bs.overrun());
+        bs.consume_bits(5);
+        CHECK(bs.overrun());
+        bit_stream bs2{data};
+        bs2.get_bits(12);
+        bs2.buffer_remaining_input();
+        bit_stream bs3{more, more + sizeof(more), bs2.buffered_bits(), bs2.available_bits()};
+        CHECK(bs3.get_bits(8) == 0xca);
+        CHECK(bs3.get_bits(4) == 0x3);
+        CHECK(!bs3.overrun());
+    }
 }
 
 std::ostream& operator<<(std::ostream& os, const huffman_code& c) {
@@ -72,6 +159,54 @@ std::ostream& operator<<(std::ostream& os, const huffman_code& c) {
     return os;
 }
 
+void test_bit_writer()
+{
+    // Random fields and codes read back with bit_stream
+    srand(42);
+    std::vector<std::pair<uint32_t, int>> fields; // Value and number of bits (negative for codes)
+    constexpr int bytes_field = 100;
+    std::vector<uint8_t> out{ 0xaa }; // Appended to
+    bit_writer w{out};
+    for (int i = 0; i < 5000; ++i) {
+        w.reserve(8);
+        const int n = rand() % 33;
+        const auto value = static_cast<uint32_t>(n ? (static_cast<uint64_t>(rand()) * 65599 + rand()) & ((1ULL << n) - 1) : 0);
+        if (n && n <= max_bits && rand() % 2) {
+            // A Huffman code is read most significant bit first
+            w.add_code(huffman_code{static_cast<uint8_t>(n), static_cast<uint16_t>(reversed_code(value & 0x7fff, n))});
+            fields.push_back({value & 0x7fff, -n});
+        } else {
+            w.add_bits(value, n);
+            fields.push_back({value, n});
+        }
+        w.flush_bits();
+        if (i % 1000 == 999) {
+            w.align_to_byte();
+            const uint8_t bytes[3] = { 1, 2, 3 };
+            w.put_bytes(bytes, 3);
+            fields.push_back({0x030201, bytes_field});
+        }
+    }
+    w.finish();
+    CHECK(out[0] == 0xaa);
+
+    bit_stream bs{out.data() + 1, out.data() + out.size()};
+    for (const auto& f : fields) {
+        if (f.second == bytes_field) {
+            bs.align_to_byte();
+            CHECK(bs.get_bits(24) == f.first);
+        } else if (f.second < 0) {
+            uint32_t code = 0;
+            for (int i = 0; i < -f.second; ++i) code = (code << 1) | bs.get_bit();
+            CHECK(code == f.first);
+        } else if (f.second) {
+            CHECK(bs.get_bits(f.second) == f.first);
+        }
+    }
+    CHECK(!bs.overrun());
+    CHECK(bs.remaining_bytes() == 0 && bs.available_bits() < 8);
+}
+
 void test_huffman_tree()
 {
     auto te = [] (int len, int index) { return huffman_tree::table_entry{static_cast<uint8_t>(len), static_cast<uint16_t>(index)}; };
@@ -170,6 +305,174 @@ void test_make_huffman_table()
     }
 }
 
+void test_decode_table()
+{
+    using entry = decode_table::entry;
+    // Codes are looked up with the first bit in the least significant position
+    auto reversed = [](uint32_t code, int len) {
+        uint32_t r = 0;
+        for (int i = 0; i < len; ++i) r |= ((code >> i) & 1) << (len - 1 - i);
+        return r;
+    };
+    std::vector<uint8_t> fixed_lengths(288, 8);
+    std::fill(fixed_lengths.begin() + 144, fixed_lengths.begin() + 256, uint8_t{9});
+    std::fill(fixed_lengths.begin() + 256, fixed_lengths.begin() + 280, uint8_t{7});
+    const decode_table lit_len{fixed_lengths.data(), 288, decode_table::alphabet::lit_len, 9};
+    CHECK(lit_len.lookup(reversed(0b00110000 + 'A', 8)) == entry(entry::literal_flag, 8, 0, 'A'));
+    CHECK(lit_len.lookup(reversed(0b110010000 + 200 - 144, 9)) == entry(entry::literal_flag, 9, 0, 200));
+    CHECK(lit_len.lookup(reversed(0b0000000, 7)).is_end_of_block());
+    CHECK(lit_len.lookup(reversed(0b0000001, 7)) == entry(0, 7, 0, 3));        // 257
+    CHECK(lit_len.lookup(reversed(0b0001001, 7)) == entry(0, 7, 1, 11));       // 265
+    CHECK(lit_len.lookup(reversed(0b11000101, 8)) == entry(0, 8, 0, 258));     // 285
+    CHECK(lit_len.lookup(reversed(0b11000110, 8)).is_invalid());               // 286
+
+    const std::vector<uint8_t> dist_lengths(32, 5);
+    const decode_table dist{dist_lengths.data(), 32, decode_table::alphabet::dist, 5};
+    CHECK(dist.lookup(reversed(4, 5)) == entry(0, 5, 1, 5));
+    CHECK(dist.lookup(reversed(29, 5)) == entry(0, 5, 13, 24577));
+    CHECK(dist.lookup(reversed(30, 5)).is_invalid());
+
+    // The compile time fixed tables match the ones built at runtime
+    for (uint32_t bits = 0; bits < (1 << max_bits); ++bits) {
+        CHECK(fixed_lit_len_decode_table.lookup(bits) == lit_len.lookup(bits));
+        CHECK(fixed_dist_decode_table.lookup(bits) == dist.lookup(bits));
+    }
+
+    // Codes longer than the table bits
+    const std::vector<uint8_t> lengths{1, 2, 4, 4, 4, 5, 5};
+    const decode_table d2{lengths.data(), 7, decode_table::alphabet::dist, 2};
+    CHECK(d2.lookup(reversed(0b0, 1)) == entry(0, 1, 0, 1));
+    CHECK(d2.lookup(reversed(0b10, 2)) == entry(0, 2, 0, 2));
+    CHECK(d2.lookup(reversed(0b1100, 4)) == entry(0, 4, 0, 3));
+    CHECK(d2.lookup(reversed(0b1110, 4)) == entry(0, 4, 1, 5));
+    CHECK(d2.lookup(reversed(0b11110, 5)) == entry(0, 5, 1, 7));
+    CHECK(d2.lookup(reversed(0b11111, 5)) == entry(0, 5, 2, 9));
+
+    // Over-subscribed and incomplete codes are rejected, except for a single 1 bit code and the empty code
+    decode_table t;
+    const uint8_t over[3] = {1, 1, 1}, incomplete[3] = {1, 2, 0}, single[3] = {0, 1, 0}, empty[3] = {0, 0, 0};
+    CHECK(!t.build(over, 3, decode_table::alphabet::dist, 6));
+    CHECK(!t.build(incomplete, 3, decode_table::alphabet::dist, 6));
+    CHECK(t.build(single, 3, decode_table::alphabet::dist, 6));
+    CHECK(t.lookup(0) == entry(0, 1, 0, 2));
+    CHECK(t.lookup(1).is_invalid());
+    CHECK(t.build(empty, 3, decode_table::alphabet::dist, 6));
+    CHECK(t.lookup(0).is_invalid() && t.lookup(1).is_invalid());
+
+    // Random complete codes (grown by splitting leaves) agree with huffman_tree
+    srand(42);
+    for (int iter = 0; iter < 200; ++iter) {
+        const int num_symbols = iter % 2 ? 288 : 30;
+        std::vector<uint8_t> code_lengths(num_symbols);
+        std::vector<int> leaves{0, 1};
+        code_lengths[0] = code_lengths[1] = 1;
+        for (int sym = 2; sym < num_symbols && rand() % 64; ++sym) {
+            const int leaf = leaves[rand() % leaves.size()];
+            if (code_lengths[leaf] == max_bits) continue;
+            code_lengths[sym] = ++code_lengths[leaf];
+            leaves.push_back(sym);
+        }
+        const int table_bits = iter % 2 ? 9 : 6;
+        CHECK(t.build(code_lengths.data(), num_symbols, decode_table::alphabet::code_length, table_bits));
+        const auto tree = make_huffman_tree(make_huffman_table(code_lengths), table_bits);
+        for (uint32_t bits = 0; bits < (1 << max_bits); ++bits) {
+            // Walk the tree a bit at a time
+            int index = huffman_tree::max_symbols, len = 0;
+            for (uint32_t b = bits; index >= huffman_tree::max_symbols; b >>= 1, ++len) {
+                index = tree.branch(index - huffman_tree::max_symbols, b & 1);
+            }
+            CHECK(t.lookup(bits) == entry(entry::literal_flag, len, 0, index));
+        }
+    }
+}
+
+void test_code_lengths()
+{
+    auto cost = [](const std::vector<uint32_t>& freqs, const uint8_t* lengths) {
+        uint64_t c = 0;
+        for (size_t i = 0; i < freqs.size(); ++i) c += static_cast<uint64_t>(freqs[i]) * lengths[i];
+        return c;
+    };
+    auto kraft_sum = [](const uint8_t* lengths, int n, int max_len) {
+        int sum = 0;
+        for (int i = 0; i < n; ++i) sum += lengths[i] ? 1 << (max_len - lengths[i]) : 0;
+        return sum;
+    };
+
+    // Compare with the cheapest complete code of limited length found by trying all of them
+    srand(42);
+    for (int iteration = 0; iteration < 50; ++iteration) {
+        const int n       = 2 + rand() % 7;
+        const int max_len = 3 + rand() % 2;
+        std::vector<uint32_t> freqs(n);
+        for (auto& f : freqs) f = rand() % 4 ? 1 + rand() % (iteration % 2 ? 1000 : 5) : 0;
+        if (iteration % 5 == 0) {
+            for (int i = 0; i < n; ++i) freqs[i] = 1u << (2 * i); // Skewed, Huffman's code is too long
+        }
+        uint8_t lengths[16];
+        make_code_lengths(freqs.data(), n, max_len, lengths);
+        CHECK(*std::max_element(lengths, lengths + n) <= max_len);
+        CHECK(kraft_sum(lengths, n, max_len) == 1 << max_len);
+        for (int i = 0; i < n; ++i) CHECK(!freqs[i] || lengths[i]);
+
+        uint64_t best = ~0ULL;
+        uint8_t candidate[16];
+        int combinations = 1;
+        for (int i = 0; i < n; ++i) combinations *= max_len + 1;
+        for (int c = 0; c < combinations; ++c) {
+            for (int i = 0, x = c; i < n; ++i, x /= max_len + 1) candidate[i] = static_cast<uint8_t>(x % (max_len + 1));
+            bool ok = kraft_sum(candidate, n, max_len) == 1 << max_len;
+            for (int i = 0; i < n; ++i) ok = ok && (!freqs[i] || candidate[i]);
+            if (ok) best = std::min(best, cost(freqs, candidate));
+        }
+        CHECK(cost(freqs, lengths) == best);
+    }
+
+    // Unused symbols get no code, but a code always has two symbols
+    const std::vector<uint32_t> single{ 0, 0, 7, 0 };
+    uint8_t lengths[4];
+    make_code_lengths(single.data(), 4, 15, lengths);
+    CHECK(lengths[2] == 1 && kraft_sum(lengths, 4, 15) == 1 << 15);
+
+    // Run-length encoded code lengths decode back
+    std::vector<uint8_t> code_lengths(140, 0);
+    code_lengths.insert(code_lengths.end(), 13, 8);
+    code_lengths.insert(code_lengths.end(), { 5, 5, 0, 0, 0, 7, 7, 7, 7, 0, 0 });
+    code_lengths.insert(code_lengths.end(), 12, 0);
+    std::vector<code_length_symbol> symbols(code_lengths.size());
+    const int num = encode_code_lengths(code_lengths.data(), static_cast<int>(code_lengths.size()), symbols.data());
+    CHECK(num == 12);
+    CHECK(symbols[0].symbol == 18 && symbols[0].extra == 127 && symbols[1].symbol == 0 && symbols[2].symbol == 0);
+    std::vector<uint8_t> decoded;
+    for (int i = 0; i < num; ++i) {
+        const auto& cs = symbols[i];
+        if (cs.symbol < 16) {
+            decoded.push_back(cs.symbol);
+        } else if (cs.symbol == 16) {
+            CHECK(!decoded.empty());
+            decoded.insert(decoded.end(), 3 + cs.extra, decoded.back());
+        } else {
+            CHECK(cs.extra < (1 << code_length_extra_bits[cs.symbol]));
+            decoded.insert(decoded.end(), (cs.symbol == 17 ? 3 : 11) + cs.extra, 0);
+        }
+    }
+    CHECK(decoded == code_lengths);
+}
+
+void test_copy_match()
+{
+    for (int distance = 1; distance <= 40; ++distance) {
+        for (int length = 3; length <= max_match_length; ++length) {
+            uint8_t buffer[64 + max_match_length + copy_match_slack];
+            for (int i = 0; i < (int)sizeof(buffer); ++i) buffer[i] = static_cast<uint8_t>(i * 13 + 7);
+            uint8_t expected[sizeof(buffer)];
+            memcpy(expected, buffer, sizeof(buffer));
+            for (int i = 0; i < length; ++i) expected[64 + i] = expected[64 + i - distance];
+            copy_match(buffer + 64, distance, length);
+            CHECK(memcmp(buffer, expected, 64 + length) == 0);
+        }
+    }
+}
 
 void test_deflate()
 {
@@ -182,14 +485,1047 @@ void test_deflate()
     CHECK(deflate::deflate(bs2) == expected_output);
 }
 
+std::vector<uint8_t> inflate_in_chunks(const uint8_t* in, const uint8_t* in_end, int in_chunk_size, int out_chunk_size, uint32_t* crc = nullptr, stream_format format = stream_format::raw)
+{
+    inflater inf = format == stream_format::raw ? inflater{crc ? inflater::checksum_type::crc32 : inflater::checksum_type::none} : inflater{format};
+    std::vector<uint8_t> res;
+    std::vector<uint8_t> out_chunk(out_chunk_size);
+    for (;;) {
+        const auto chunk_end = in + std::min(static_cast<int>(in_end - in), in_chunk_size);
+        uint8_t* out = out_chunk.data();
+        const auto st = inf.inflate(in, chunk_end, out, out_chunk.data() + out_chunk.size());
+        res.insert(res.end(), out_chunk.data(), out);
+        if (st == inflater::status::done && (format != stream_format::gzip || in == in_end)) {
+            CHECK(inf.done());
+            if (crc) *crc = inf.checksum();
+            return res;
+        }
+        CHECK(st == inflater::status::need_output || in == chunk_end);
+        CHECK(st != inflater::status::need_output || out == out_chunk.data() + out_chunk.size());
+        CHECK(in != in_end || st != inflater::status::need_input);
+    }
+}
+
+void test_inflater()
+{
+    {
+        const uint8_t input[13] = {0xf3, 0xc9, 0xcc, 0x4b, 0x55, 0x30, 0xe4, 0xf2, 0x01, 0x51, 0x46, 0x5c, 0x00};
+        const std::vector<uint8_t> expected_output{ 'L', 'i', 'n', 'e', ' ', '1', '\n', 'L', 'i', 'n', 'e', ' ', '2', '\n'};
+        CHECK(inflate_in_chunks(input, input + sizeof(input), 1, 1) == expected_output);
+        CHECK(inflate_in_chunks(input, input + sizeof(input), 100, 100) == expected_output);
+    }
+
+    // Dynamic huffman blocks decoding to more than two windows of output with back-references across the window
+    const uint8_t input[427] = {
+        0xed, 0xd8, 0x47, 0x11, 0x03, 0x40, 0x10, 0x04, 0x31, 0xac, 0xe7, 0x9c, 0x73, 0x46, 0x6f, 0x04,
+        0x4d, 0xc0, 0x56, 0x53, 0x58, 0xd5, 0x3c, 0x76, 0x8c, 0x68, 0x52, 0x4d, 0xab, 0x59, 0x35, 0xaf,
+        0x16, 0xd5, 0xb2, 0x5a, 0x55, 0xeb, 0x6a, 0x53, 0x6d, 0xab, 0x5d, 0xb5, 0xaf, 0x0e, 0xd5, 0xb1,
+        0x3a, 0x55, 0xe7, 0xea, 0x52, 0x5d, 0xab, 0x5b, 0x75, 0xaf, 0x1e, 0xd5, 0xb3, 0x7a, 0x55, 0xef,
+        0xea, 0x53, 0x0d, 0x12, 0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24,
+        0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0xc4, 0x9f, 0x96, 0xe8, 0x82, 0xb6, 0xc4, 0x96, 0x90, 0x48,
+        0x22, 0x89, 0x24, 0x92, 0x48, 0x22, 0x89, 0x24, 0x92, 0x48, 0x22, 0x89, 0x24, 0x92, 0x48, 0x22,
+        0x89, 0x24, 0xfa, 0xc3, 0xb9, 0xa0, 0x2d, 0x21, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44, 0x12,
+        0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0xf4, 0x87, 0x73, 0x41, 0x5b,
+        0x62, 0x4b, 0x48, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44,
+        0x12, 0x49, 0x24, 0x91, 0x44, 0x12, 0xfd, 0xe1, 0x6c, 0x89, 0x2d, 0x21, 0x91, 0x44, 0x12, 0x49,
+        0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0xf4,
+        0x87, 0x73, 0x41, 0x5b, 0x62, 0x4b, 0x48, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44, 0x12,
+        0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44, 0x7f, 0x38, 0x17, 0xb4, 0x25, 0xb6, 0x84,
+        0x44, 0x12, 0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44,
+        0x12, 0x49, 0x24, 0xd1, 0x1f, 0xce, 0x05, 0x6d, 0x09, 0x89, 0x24, 0x92, 0x48, 0x22, 0x89, 0x24,
+        0x92, 0x48, 0x22, 0x89, 0x24, 0x92, 0x48, 0x22, 0x89, 0x24, 0x92, 0x48, 0xa2, 0x3f, 0x9c, 0x0b,
+        0xda, 0x12, 0x5b, 0x42, 0x22, 0x89, 0x24, 0x92, 0x48, 0x22, 0x89, 0x24, 0x92, 0x48, 0x22, 0x89,
+        0x24, 0x92, 0x48, 0x22, 0x89, 0x24, 0x92, 0xe8, 0x0f, 0x67, 0x4b, 0x6c, 0x09, 0x89, 0x24, 0x92,
+        0x48, 0x22, 0x89, 0x24, 0x92, 0x48, 0x22, 0x89, 0x24, 0x92, 0x48, 0x22, 0x89, 0x24, 0x92, 0x48,
+        0xa2, 0x3f, 0x9c, 0x0b, 0xda, 0x12, 0x12, 0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44,
+        0x12, 0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44, 0x7f, 0x38, 0x17, 0xb4, 0x25, 0xb6,
+        0x84, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91,
+        0x44, 0x12, 0x49, 0x24, 0xd1, 0x1f, 0xce, 0x96, 0xd8, 0x12, 0x12, 0x49, 0x24, 0x91, 0x44, 0x12,
+        0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44, 0x7f, 0x38,
+        0x17, 0xb4, 0x25, 0xb6, 0x84, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0x24, 0x91, 0x44,
+        0x12, 0x49, 0x24, 0x91, 0x44, 0x12, 0x49, 0xfc, 0x3f, 0x89, 0x5f,
+    };
+    std::vector<uint8_t> expected_output(70000);
+    for (int i = 0; i < (int)expected_output.size(); ++i) {
+        expected_output[i] = static_cast<uint8_t>('a' + (i % 5000) / 25 % 26);
+    }
+    bit_stream bs{input};
+    CHECK(deflate::deflate(bs) == expected_output);
+    CHECK(inflate_in_chunks(input, input + sizeof(input), 1, 1) == expected_output);
+    CHECK(inflate_in_chunks(input, input + sizeof(input), 3, 1000) == expected_output);
+    CHECK(inflate_in_chunks(input, input + sizeof(input), 1000, 7) == expected_output);
+    CHECK(inflate_in_chunks(input, input + sizeof(input), 1000, 100000) == expected_output);
+
+    uint32_t crc = 0;
+    CHECK(inflate_in_chunks(input, input + sizeof(input), 5, 333, &crc) == expected_output);
+    CHECK(crc == 0x8c898c9e);
+    inflater inf{inflater::checksum_type::adler32};
+    const uint8_t* in = input;
+    std::vector<uint8_t> output(expected_output.size());
+    uint8_t* out = output.data();
+    CHECK(inf.inflate(in, input + sizeof(input), out, output.data() + output.size()) == inflater::status::done);
+    CHECK(output == expected_output);
+    CHECK(inf.checksum() == 0xf15f99c5);
+}
+
+void test_stored_blocks()
+{
+    // A stored block, an empty stored block (sync flush) and a compressed block with matches into the stored data
+    std::vector<uint8_t> stored(1000);
+    for (int i = 0; i < (int)stored.size(); ++i) stored[i] = static_cast<uint8_t>(i * i + 3 * i);
+    std::vector<uint8_t> input{ 0x00, 0xe8, 0x03, 0x17, 0xfc };
+    input.insert(input.end(), stored.begin(), stored.end());
+    for (auto b : { 0x00, 0x00, 0x00, 0xff, 0xff, 0x1b, 0x8d, 0x03, 0xe2, 0xfd, 0x3f, 0x9a, 0x3f, 0x06, 0x97, 0xff, 0x4b, 0x12, 0x33, 0x73, 0x00 }) {
+        input.push_back(static_cast<uint8_t>(b));
+    }
+    auto expected_output = stored;
+    expected_output.insert(expected_output.end(), stored.begin() + 100, stored.begin() + 400);
+    expected_output.insert(expected_output.end(), stored.begin() + 500, stored.begin() + 900);
+    for (auto c : { 't', 'a', 'i', 'l' }) expected_output.push_back(static_cast<uint8_t>(c));
+
+    bit_stream bs{input.data(), input.data() + input.size()};
+    CHECK(deflate::deflate(bs) == expected_output);
+    CHECK(inflate_in_chunks(input.data(), input.data() + input.size(), 1, 1) == expected_output);
+    CHECK(inflate_in_chunks(input.data(), input.data() + input.size(), 3, 100) == expected_output);
+    CHECK(inflate_in_chunks(input.data(), input.data() + input.size(), 700, 10000) == expected_output);
+
+    // Stored blocks larger than the window following a fixed huffman block
+    // "Line 1\n" in a fixed huffman block followed by an empty stored block
+    std::vector<uint8_t> big_input{ 0xf2, 0xc9, 0xcc, 0x4b, 0x55, 0x30, 0xe4, 0x02, 0x00, 0x00, 0x00, 0xff, 0xff };
+    std::vector<uint8_t> big_expected{ 'L', 'i', 'n', 'e', ' ', '1', '\n' };
+    for (int block = 0; block < 3; ++block) {
+        const int len = 65535 - block;
+        big_input.push_back(block == 2 ? 1 : 0);
+        big_input.push_back(static_cast<uint8_t>(len));
+        big_input.push_back(static_cast<uint8_t>(len >> 8));
+        big_input.push_back(static_cast<uint8_t>(~len));
+        big_input.push_back(static_cast<uint8_t>(~len >> 8));
+        for (int i = 0; i < len; ++i) {
+            const auto b = static_cast<uint8_t>(i * 31 + block);
+            big_input.push_back(b);
+            big_expected.push_back(b);
+        }
+    }
+    bit_stream big_bs{big_input.data(), big_input.data() + big_input.size()};
+    CHECK(deflate::deflate(big_bs) == big_expected);
+    CHECK(inflate_in_chunks(big_input.data(), big_input.data() + big_input.size(), 1, 1) == big_expected);
+    CHECK(inflate_in_chunks(big_input.data(), big_input.data() + big_input.size(), 10000, 333) == big_expected);
+    CHECK(inflate_in_chunks(big_input.data(), big_input.data() + big_input.size(), 70000, 200000) == big_expected);
+}
+
+void test_stream_formats()
+{
+    // gzip member with FHCRC, FEXTRA, FNAME and FCOMMENT followed by a plain member
+    std::vector<uint8_t> gzip_input{
+        0x1f, 0x8b, 0x08, 0x1e, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x04, 0x00, 0x61, 0x62, 0x00, 0x00,
+        0x66, 0x2e, 0x74, 0x78, 0x74, 0x00, 0x68, 0x69, 0x00, 0x58, 0x1c, 0x73, 0xcb, 0x2c, 0x2a, 0x2e,
+        0x51, 0xc8, 0x4d, 0xcd, 0x4d, 0x4a, 0x2d, 0xe2, 0x72, 0xc3, 0xc9, 0x01, 0x00, 0x44, 0xf1, 0xde,
+        0x21, 0x27, 0x00, 0x00, 0x00,
+        0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x0b, 0x4e, 0x4d, 0xce, 0xcf, 0x4b,
+        0xe1, 0x02, 0x00, 0xe2, 0xf9, 0xb2, 0xc9, 0x07, 0x00, 0x00, 0x00,
+    };
+    const uint8_t zlib_input[24] = {
+        0x78, 0x9c, 0x73, 0xcb, 0x2c, 0x2a, 0x2e, 0x51, 0xc8, 0x4d, 0xcd, 0x4d, 0x4a, 0x2d, 0xe2, 0x72,
+        0xc3, 0xc9, 0x01, 0x00, 0x1c, 0x4f, 0x0d, 0xff,
+    };
+    const std::string first = "First member\nFirst member\nFirst member\n";
+    const std::string second = "Second\n";
+    const std::vector<uint8_t> first_output(first.begin(), first.end());
+    auto gzip_output = first_output;
+    gzip_output.insert(gzip_output.end(), second.begin(), second.end());
+
+    const auto gzip_begin = gzip_input.data(), gzip_end = gzip_input.data() + gzip_input.size();
+    CHECK(decompress(stream_format::gzip, gzip_begin, gzip_end) == gzip_output);
+    CHECK(decompress(stream_format::gzip, gzip_begin, gzip_begin + 53) == first_output);
+    CHECK(decompress(stream_format::zlib, zlib_input, zlib_input + sizeof(zlib_input)) == first_output);
+    for (int in_chunk : { 1, 5, 53, 1000 }) {
+        CHECK(inflate_in_chunks(gzip_begin, gzip_end, in_chunk, 3, nullptr, stream_format::gzip) == gzip_output);
+        CHECK(inflate_in_chunks(zlib_input, zlib_input + sizeof(zlib_input), in_chunk, 3, nullptr, stream_format::zlib) == first_output);
+    }
+
+    // Input following the end of a raw or zlib stream is left unconsumed
+    std::vector<uint8_t> zlib_trailing(zlib_input, zlib_input + sizeof(zlib_input));
+    zlib_trailing.push_back(0xaa);
+    for (auto format : { stream_format::raw, stream_format::zlib }) {
+        inflater inf{format};
+        const uint8_t* in = format == stream_format::raw ? zlib_trailing.data() + 2 : zlib_trailing.data();
+        std::vector<uint8_t> output(100);
+        uint8_t* out = output.data();
+        CHECK(inf.inflate(in, zlib_trailing.data() + zlib_trailing.size(), out, output.data() + output.size()) == inflater::status::done);
+        CHECK(std::vector<uint8_t>(output.data(), out) == first_output);
+        CHECK(in == zlib_trailing.data() + zlib_trailing.size() - (format == stream_format::raw ? 5 : 1));
+    }
+
+    auto throws = [](stream_format format, const std::vector<uint8_t>& input) {
+        try {
+            decompress(format, input.data(), input.data() + input.size());
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    CHECK(!throws(stream_format::gzip, gzip_input));
+    for (int pos : { 0, 3, 45, 49, 55 }) {
+        auto corrupt = gzip_input;
+        corrupt[pos] ^= 0x80; // ID1, reserved flag, CRC, ISIZE and CM
+        CHECK(throws(stream_format::gzip, corrupt));
+    }
+    CHECK(throws(stream_format::gzip, std::vector<uint8_t>(gzip_begin, gzip_end - 1)));
+    CHECK(throws(stream_format::gzip, std::vector<uint8_t>(gzip_begin, gzip_begin + 54)));
+    std::vector<uint8_t> zlib_corrupt(zlib_input, zlib_input + sizeof(zlib_input));
+    CHECK(!throws(stream_format::zlib, zlib_corrupt));
+    zlib_corrupt[23] ^= 1;
+    CHECK(throws(stream_format::zlib, zlib_corrupt));
+    zlib_corrupt[23] ^= 1;
+    zlib_corrupt[1] ^= 1;
+    CHECK(throws(stream_format::zlib, zlib_corrupt));
+}
+
+void test_parallel_inflate()
+{
+    // Members with independent (full flush) blocks, with a dependent block after a sync flush and with stored data
+    // containing a gzip header and a sync flush marker
+    const std::vector<uint8_t> input{
+        0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0xf2, 0xc9, 0xcc, 0x4b, 0x55, 0x30,
+        0x50, 0xc8, 0x4f, 0x53, 0x28, 0xc9, 0x48, 0x55, 0x48, 0xcb, 0x2c, 0x2a, 0x2e, 0x51, 0x28, 0x4e,
+        0x4d, 0xcf, 0x4d, 0xcd, 0x2b, 0xe1, 0xf2, 0x01, 0xc9, 0x19, 0xe2, 0x91, 0x33, 0xc2, 0x23, 0x67,
+        0x8c, 0x47, 0xce, 0x04, 0x8f, 0x9c, 0x29, 0x1e, 0x39, 0x33, 0x3c, 0x72, 0xe6, 0x78, 0xe4, 0x2c,
+        0xf0, 0xc8, 0x59, 0xe2, 0xf3, 0x3b, 0xde, 0x80, 0xc1, 0x11, 0x32, 0x00, 0x00, 0x00, 0x00, 0xff,
+        0xff, 0xf2, 0xc9, 0xcc, 0x4b, 0x55, 0x30, 0x50, 0xc8, 0x4f, 0x53, 0x28, 0xc9, 0x48, 0x55, 0x48,
+        0xcb, 0x2c, 0x2a, 0x2e, 0x51, 0x28, 0x4e, 0x4d, 0xcf, 0x4d, 0xcd, 0x2b, 0xe1, 0xf2, 0x01, 0xc9,
+        0x19, 0xe2, 0x91, 0x33, 0xc2, 0x23, 0x67, 0x8c, 0x47, 0xce, 0x04, 0x8f, 0x9c, 0x29, 0x1e, 0x39,
+        0x33, 0x3c, 0x72, 0xe6, 0x78, 0xe4, 0x2c, 0xf0, 0xc8, 0x59, 0xe2, 0xf3, 0x3b, 0xde, 0x80, 0xc1,
+        0x11, 0x32, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0x73, 0xcc, 0xcb, 0x2f, 0xc9, 0x48, 0x2d, 0x52,
+        0x28, 0x4e, 0x4d, 0xcf, 0x4d, 0xcd, 0x2b, 0xd1, 0x51, 0x48, 0xce, 0xcf, 0x2d, 0x28, 0x4a, 0x2d,
+        0x2e, 0x4e, 0x4d, 0x51, 0xc8, 0xcf, 0x53, 0xc8, 0x2c, 0x29, 0x56, 0xc8, 0x2f, 0xcf, 0xd3, 0x53,
+        0x70, 0x1c, 0x20, 0x75, 0x00, 0x57, 0x04, 0x20, 0x4d, 0x44, 0x03, 0x00, 0x00, 0x1f, 0x8b, 0x08,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x72, 0xcc, 0xcb, 0x2f, 0xc9, 0x48, 0x2d, 0x52, 0x28,
+        0x4e, 0x4d, 0xcf, 0x4d, 0xcd, 0x2b, 0xd1, 0x51, 0x48, 0xce, 0xcf, 0x2d, 0x28, 0x4a, 0x2d, 0x2e,
+        0x4e, 0x4d, 0x51, 0xc8, 0xcf, 0x53, 0xc8, 0x2c, 0x29, 0x56, 0xc8, 0x2f, 0xcf, 0xd3, 0x53, 0x70,
+        0x1c, 0x20, 0x75, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0x1b, 0xec, 0xea, 0x00, 0x27, 0xe0, 0x67,
+        0xdb, 0x40, 0x01, 0x00, 0x00, 0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x03, 0x01,
+        0x28, 0x00, 0xd7, 0xff, 0x67, 0x7a, 0x69, 0x70, 0x20, 0x1f, 0x8b, 0x08, 0x00, 0x20, 0x61, 0x6e,
+        0x64, 0x20, 0x73, 0x79, 0x6e, 0x63, 0x20, 0x66, 0x6c, 0x75, 0x73, 0x68, 0x20, 0x00, 0x00, 0xff,
+        0xff, 0x20, 0x6c, 0x6f, 0x6f, 0x6b, 0x61, 0x6c, 0x69, 0x6b, 0x65, 0x73, 0x27, 0xf9, 0x7d, 0xb8,
+        0x28, 0x00, 0x00, 0x00,
+    };
+    std::string first, second;
+    for (int i = 0; i < 12; ++i) first += "Line " + std::to_string(i) + " of the first segment\n";
+    for (int i = 0; i < 4; ++i) second += "Another segment, compressed on its own. ";
+    const std::string expected = first + first + second + second + second + "gzip \x1f\x8b\x08" + std::string(1, '\0') +
+        " and sync flush " + std::string(2, '\0') + "\xff\xff lookalikes";
+    const std::vector<uint8_t> expected_output(expected.begin(), expected.end());
+
+    const auto begin = input.data(), end = input.data() + input.size();
+    CHECK(decompress(stream_format::gzip, begin, end) == expected_output);
+    for (int threads : { 1, 3 }) {
+        for (int chunk_size : { 1, 2, 5, 64, 100, 0 }) {
+            CHECK(decompress_parallel(begin, end, threads, chunk_size) == expected_output);
+        }
+    }
+
+    auto throws = [](const std::vector<uint8_t>& in) {
+        try {
+            decompress_parallel(in.data(), in.data() + in.size(), 2, 3);
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    CHECK(throws({}));
+    CHECK(throws(std::vector<uint8_t>(begin, end - 1)));
+    CHECK(throws(std::vector<uint8_t>(begin, begin + 100)));
+    for (int pos : { 0, 197, 202, 216, 330 }) {
+        auto corrupt = input;
+        corrupt[pos] ^= 0x80; // ID1, CRC, ISIZE, deflate data and stored data
+        CHECK(throws(corrupt));
+    }
+
+    // A member compressed with the preceding one as history is invalid, as for decompress()
+    const auto text = expected_output.data(), middle = text + expected_output.size() / 2, text_end = text + expected_output.size();
+    auto dependent = compress(stream_format::gzip, text, middle);
+    put_gzip_header(dependent, 6);
+    deflater{6}.compress(text, middle, text_end, true, dependent);
+    put_gzip_trailer(dependent, update_crc32(0, middle, text_end), static_cast<uint32_t>(text_end - middle));
+    auto distance_error = [&](auto&& decompressor) {
+        try {
+            decompressor();
+        } catch (const deflate_error& e) {
+            return e.code() == error_code::invalid_distance;
+        }
+        return false;
+    };
+    CHECK(distance_error([&] { decompress(stream_format::gzip, dependent.data(), dependent.data() + dependent.size()); }));
+    for (int chunk_size : { 1, 64, 0 }) {
+        CHECK(distance_error([&] { decompress_parallel(dependent.data(), dependent.data() + dependent.size(), 2, chunk_size); }));
+    }
+}
+
+// gzip file of a single member with several dynamic blocks and a fixed block
+const std::vector<uint8_t> squares_gzip{
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x2c, 0x8e, 0xd1, 0x15, 0x03, 0x30,
+    0x08, 0x02, 0x57, 0x61, 0x04, 0x4d, 0xd0, 0xc4, 0xfd, 0x17, 0xeb, 0xa5, 0xed, 0x17, 0x4f, 0x3d,
+    0x84, 0x50, 0xca, 0x1a, 0x65, 0x6b, 0x95, 0x76, 0xcb, 0xa3, 0xb6, 0x6e, 0x2a, 0x23, 0x94, 0x0b,
+    0xb5, 0xb9, 0x42, 0x0c, 0x08, 0xcc, 0x2a, 0xf4, 0x8e, 0xf6, 0x32, 0x3c, 0x6e, 0x38, 0x1b, 0xbd,
+    0x56, 0xad, 0x51, 0x9d, 0x56, 0xc3, 0x35, 0x7a, 0x98, 0x0f, 0xfb, 0xcb, 0x7d, 0xe0, 0x06, 0x1e,
+    0x1b, 0xee, 0xac, 0xff, 0x37, 0xbe, 0x6e, 0xbe, 0xdb, 0xcf, 0x9d, 0x6a, 0xa8, 0x26, 0xfd, 0xbc,
+    0x12, 0x74, 0x99, 0xfd, 0x2d, 0x96, 0xaf, 0x5f, 0x10, 0x1a, 0x26, 0x30, 0x55, 0x0f, 0x43, 0x0f,
+    0xf3, 0x65, 0x3f, 0xbf, 0xfe, 0xf9, 0x68, 0x5c, 0x1b, 0xb7, 0x3f, 0x2c, 0x91, 0xdb, 0x15, 0x44,
+    0x21, 0x08, 0x03, 0x5b, 0xd9, 0x12, 0xae, 0x80, 0x80, 0xfd, 0x37, 0xb6, 0xc3, 0xe3, 0xcb, 0xa3,
+    0x42, 0x32, 0x81, 0x1c, 0xb5, 0x40, 0x35, 0x51, 0x7f, 0xb8, 0x6c, 0x04, 0xc5, 0xdc, 0x80, 0x70,
+    0x58, 0xc2, 0x07, 0x0d, 0xc2, 0x03, 0xa9, 0x42, 0x6c, 0x9b, 0x20, 0x38, 0x1f, 0x77, 0x9e, 0xc5,
+    0x26, 0xe8, 0xa5, 0x3a, 0x2a, 0x01, 0xdd, 0x9b, 0x40, 0x11, 0xbd, 0x68, 0x47, 0x79, 0xc8, 0xcc,
+    0x4d, 0xf0, 0x36, 0x18, 0x1c, 0x96, 0x9c, 0x04, 0x02, 0xa1, 0x41, 0xea, 0x4d, 0x7c, 0x7e, 0x14,
+    0x7d, 0xa5, 0x49, 0x11, 0xaf, 0x39, 0xfc, 0x52, 0x0b, 0xa8, 0x0d, 0x54, 0xfa, 0xdd, 0x81, 0xa2,
+    0x79, 0xad, 0x40, 0xe1, 0xdf, 0x00, 0x86, 0xb7, 0x83, 0xf0, 0xa4, 0x76, 0x33, 0x68, 0x0e, 0x62,
+    0x82, 0x7a, 0x20, 0xd6, 0x4d, 0x90, 0x9c, 0x7d, 0x4f, 0xeb, 0xff, 0x0a, 0xda, 0xf5, 0xf4, 0x75,
+    0xff, 0x66, 0x30, 0x74, 0xa3, 0xb7, 0xd0, 0x76, 0x35, 0xb6, 0xb6, 0xaf, 0x31, 0x82, 0x13, 0x13,
+    0x41, 0x81, 0x2c, 0xd8, 0x07, 0xb4, 0xec, 0x12, 0xfe, 0x34, 0x93, 0x51, 0x02, 0x80, 0x20, 0x08,
+    0x43, 0xcf, 0x24, 0xa1, 0xe1, 0xfd, 0x2f, 0xd6, 0xde, 0xa0, 0xaf, 0x4a, 0x49, 0xd9, 0xde, 0x40,
+    0xca, 0x32, 0x14, 0x95, 0x4d, 0x88, 0x54, 0x8d, 0xf0, 0xab, 0xbf, 0x63, 0x20, 0x60, 0x4c, 0x80,
+    0x58, 0x97, 0xd4, 0x88, 0xd8, 0xba, 0x1c, 0x1f, 0x23, 0xd2, 0xbe, 0xd2, 0x1c, 0x3e, 0xef, 0x4a,
+    0xdb, 0x1e, 0x23, 0xe2, 0xea, 0x09, 0x96, 0xa3, 0xf5, 0xc1, 0x00, 0xb4, 0x15, 0x69, 0x88, 0x35,
+    0x1a, 0xb6, 0x8e, 0x85, 0xf1, 0x83, 0x57, 0xc3, 0x81, 0x0c, 0x14, 0x6d, 0xe0, 0x69, 0x8b, 0x48,
+    0x35, 0x49, 0x62, 0xc2, 0xce, 0xc3, 0x81, 0x3c, 0x95, 0x25, 0xa9, 0xa8, 0x25, 0xa4, 0x6a, 0x49,
+    0x5f, 0xc0, 0x70, 0x38, 0x90, 0xce, 0x8b, 0x41, 0xb0, 0x1e, 0x09, 0x07, 0x09, 0x4a, 0x42, 0xa4,
+    0xa3, 0x4d, 0x6b, 0x44, 0x3d, 0x2a, 0x1d, 0xfd, 0xf5, 0x07, 0xe9, 0x78, 0x32, 0x2e, 0x02, 0x86,
+    0x02, 0x93, 0x53, 0x91, 0x9e, 0xa4, 0x77, 0x14, 0x1c, 0x9d, 0xca, 0xa4, 0x1d, 0x26, 0xee, 0xc7,
+    0x20, 0x3f, 0xa0, 0xa0, 0x4b, 0xba, 0xff, 0xad, 0x0e, 0xf5, 0xa1, 0x7e, 0x1b, 0xc0, 0xf2, 0xfb,
+    0xf5, 0x3a, 0xdb, 0x3d, 0xc2, 0xbb, 0x67, 0xf8, 0xa3, 0x99, 0x0e, 0x6c, 0x20, 0x0a, 0x41, 0x20,
+    0x0a, 0xd6, 0x84, 0x22, 0x42, 0xff, 0x8d, 0x5d, 0x7e, 0x9c, 0xeb, 0x60, 0x5f, 0x36, 0x53, 0x0c,
+    0x17, 0xc3, 0x65, 0xf7, 0x65, 0xb8, 0x19, 0x1e, 0x86, 0x87, 0x61, 0xbb, 0x03, 0xe1, 0x85, 0x70,
+    0x22, 0x7c, 0x9e, 0xe1, 0xb2, 0xfb, 0x32, 0x3c, 0x0c, 0x07, 0xc3, 0x8b, 0xe1, 0x7c, 0xcb, 0x8b,
+    0xe1, 0x66, 0xf8, 0x09, 0x5e, 0x04, 0xe7, 0xdb, 0x5f, 0x04, 0x37, 0xc1, 0x41, 0xf0, 0x26, 0xf8,
+    0x28, 0x68, 0x84, 0x03, 0xe1, 0x7c, 0x84, 0x0b, 0xe1, 0x51, 0xb0, 0x10, 0x3e, 0x0c, 0x0f, 0xc3,
+    0xeb, 0x6f, 0x58, 0x42, 0x43, 0xbc, 0x20, 0x2e, 0x88, 0x07, 0xe2, 0xfd, 0x12, 0x2e, 0xc4, 0x01,
+    0xf1, 0x77, 0xc0, 0x27, 0x61, 0x30, 0xde, 0x2f, 0xe2, 0x62, 0x1c, 0x18, 0x17, 0xc6, 0x14, 0xa7,
+    0x86, 0xa1, 0x38, 0x29, 0x1e, 0x8a, 0x37, 0xc5, 0x2d, 0x62, 0x53, 0xdc, 0x14, 0x27, 0xc5, 0x43,
+    0x71, 0x8a, 0x18, 0x8a, 0x0f, 0xc6, 0xf1, 0x63, 0xaf, 0x0e, 0x6c, 0x20, 0x86, 0x41, 0x28, 0x86,
+    0xae, 0x74, 0x24, 0x1c, 0x34, 0xfb, 0x2f, 0x56, 0x45, 0xb8, 0x5b, 0x78, 0x83, 0x7c, 0x85, 0x27,
+    0xc3, 0xb8, 0x60, 0xbc, 0x66, 0xc4, 0x03, 0xe3, 0x84, 0xf1, 0x20, 0x2e, 0x10, 0xaf, 0x99, 0xf0,
+    0x80, 0x38, 0x41, 0x1c, 0x20, 0x6e, 0x10, 0xef, 0x0f, 0xf1, 0x18, 0x6e, 0x0c, 0x27, 0x86, 0x21,
+    0xdc, 0x2c, 0x48, 0x08, 0xc7, 0x10, 0x3e, 0x10, 0x2e, 0x08, 0xef, 0x6f, 0xc0, 0x08, 0x7e, 0x10,
+    0x5c, 0x08, 0xde, 0x08, 0x8e, 0x79, 0xff, 0x41, 0x70, 0x23, 0xf8, 0x7e, 0xc2, 0xbd, 0xa7, 0x8d,
+    0xe1, 0x98, 0x05, 0x07, 0xc3, 0x8d, 0xe1, 0xc2, 0x70, 0x62, 0x78, 0xb1, 0x20, 0xc6, 0x30, 0x84,
+    0x0f, 0x84, 0x1b, 0xc2, 0xc5, 0x82, 0x3f, 0x86, 0x13, 0xc3, 0x89, 0xe1, 0x8d, 0xe1, 0xc5, 0x84,
+    0xc0, 0x70, 0x60, 0x38, 0xc6, 0xf0, 0x10, 0xa6, 0x65, 0x17, 0xf0, 0xe5, 0xfb, 0xb3, 0xbd, 0xb6,
+    0xd7, 0xf6, 0xda, 0x5e, 0xdb, 0x6b, 0x7b, 0x6d, 0xaf, 0xed, 0xb5, 0xbd, 0xb6, 0xd7, 0xf6, 0xda,
+    0x5e, 0xdb, 0x6b, 0x7b, 0x6d, 0xaf, 0xed, 0xb5, 0xbd, 0xb6, 0xd7, 0xf6, 0xda, 0x5e, 0xdb, 0x6b,
+    0x7b, 0x6d, 0xaf, 0xed, 0xb5, 0xbd, 0xb6, 0xf7, 0xdd, 0x68, 0xdd, 0x3b, 0x5a, 0xf7, 0x8e, 0xd6,
+    0xbd, 0x43, 0xb2, 0xee, 0x05, 0x00, 0x88, 0xaa, 0xfc, 0x1f, 0x6c, 0x25, 0x00, 0x00,
+};
+
+std::vector<uint8_t> squares_text()
+{
+    std::string text;
+    for (int i = 0; i < 2500; ++i) text += std::to_string(i * i % 1000) + " ";
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+void test_speculative_inflate()
+{
+    const auto& input = squares_gzip;
+    const auto expected_output = squares_text();
+
+    const auto begin = input.data(), end = input.data() + input.size();
+    CHECK(decompress(stream_format::gzip, begin, end) == expected_output);
+    for (int threads : { 1, 3 }) {
+        for (int chunk_size : { 50, 100, 200, 400, 0 }) {
+            CHECK(decompress_speculative(begin, end, threads, chunk_size) == expected_output);
+        }
+    }
+    auto two_members = input;
+    two_members.insert(two_members.end(), begin, end);
+    auto expected_two = expected_output;
+    expected_two.insert(expected_two.end(), expected_output.begin(), expected_output.end());
+    CHECK(decompress_speculative(two_members.data(), two_members.data() + two_members.size(), 2, 100) == expected_two);
+
+    auto throws = [](const std::vector<uint8_t>& in) {
+        try {
+            decompress_speculative(in.data(), in.data() + in.size(), 2, 100);
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    CHECK(throws({}));
+    CHECK(throws(std::vector<uint8_t>(begin, end - 1)));
+    CHECK(throws(std::vector<uint8_t>(begin, begin + 500)));
+    for (int pos : { 0, 400, 790, 795 }) {
+        auto corrupt = input;
+        corrupt[pos] ^= 0x80; // ID1, deflate data, CRC and ISIZE
+        CHECK(throws(corrupt));
+    }
+
+    // Matches reaching before the start of the output from a chunk whose window is only known when the markers are
+    // resolved
+    std::vector<uint8_t> stored(20000, 'x'), far_matches;
+    stored.back() = 0xff;
+    put_gzip_header(far_matches, 0);
+    deflater{0}.compress(stored.data(), stored.data(), stored.data() + stored.size(), false, far_matches);
+    {
+        bit_writer w{far_matches};
+        w.reserve(64);
+        w.add_bits(0b011, 3); // Final fixed block
+        for (int i = 0; i < 10; ++i) {
+            w.add_bits(reversed_code(0b11000101, 8), 8); // Length 258
+            w.add_bits(reversed_code(29, 5), 5);         // Distance 32767
+            w.add_bits(8190, 13);
+            w.flush_bits();
+        }
+        w.add_bits(0, 7);
+        w.finish();
+    }
+    put_gzip_trailer(far_matches, 0, 0);
+    for (int chunk_size : { 0, 16384 }) {
+        bool thrown = false;
+        try {
+            decompress_speculative(far_matches.data(), far_matches.data() + far_matches.size(), 2, chunk_size);
+        } catch (const deflate_error& e) {
+            thrown = e.code() == error_code::invalid_distance;
+        }
+        CHECK(thrown);
+    }
+}
+
+void test_gzip_index()
+{
+    // Two members, so checkpoints are also taken at the start of the second one
+    auto input = squares_gzip;
+    input.insert(input.end(), squares_gzip.begin(), squares_gzip.end());
+    auto expected_output = squares_text();
+    expected_output.insert(expected_output.end(), expected_output.begin(), expected_output.end());
+    const auto begin = input.data(), end = input.data() + input.size();
+
+    const gzip_index index{begin, end, 1000};
+    CHECK(index.uncompressed_size() == expected_output.size());
+    CHECK(index.points().size() > 4);
+    CHECK(index.points()[0].output_offset == 0 && index.points()[0].window.empty());
+    CHECK(gzip_index(begin, end).points().size() == 1);
+
+    auto check_ranges = [&](const gzip_index& idx) {
+        for (size_t offset = 0; offset <= expected_output.size() + 10; offset += 331) {
+            for (size_t size : { 1, 100, 5000 }) {
+                std::vector<uint8_t> out(size);
+                const auto n = idx.extract(begin, end, offset, out.data(), size);
+                const auto expected_n = std::min(size, expected_output.size() - std::min(offset, expected_output.size()));
+                CHECK(n == expected_n);
+                CHECK(std::equal(out.begin(), out.begin() + n, expected_output.begin() + std::min(offset, expected_output.size())));
+            }
+        }
+    };
+    check_ranges(index);
+
+    const auto serialized = index.serialize();
+    const auto loaded = gzip_index::deserialize(serialized.data(), serialized.data() + serialized.size());
+    CHECK(loaded.uncompressed_size() == index.uncompressed_size() && loaded.points().size() == index.points().size());
+    size_t window_bytes = 0;
+    for (size_t i = 0; i < index.points().size(); ++i) {
+        CHECK(loaded.points()[i].window == index.points()[i].window);
+        window_bytes += index.points()[i].window.size();
+    }
+    CHECK(serialized.size() < window_bytes / 2); // The windows are compressed
+    check_ranges(loaded);
+
+    auto throws = [](const std::vector<uint8_t>& in) {
+        try {
+            gzip_index::deserialize(in.data(), in.data() + in.size());
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    CHECK(throws({}));
+    CHECK(throws(std::vector<uint8_t>(serialized.begin(), serialized.end() - 1)));
+    auto bad_magic = serialized;
+    bad_magic[0] ^= 1;
+    CHECK(throws(bad_magic));
+    auto bad_window = serialized;
+    bad_window[bad_window.size() - 1] ^= 0xff; // In the last window's stream
+    CHECK(throws(bad_window));
+
+    auto corrupt = input;
+    corrupt[790] ^= 0x80; // CRC
+    bool thrown = false;
+    try {
+        gzip_index(corrupt.data(), corrupt.data() + corrupt.size());
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+void test_deflater()
+{
+    std::vector<std::vector<uint8_t>> inputs{ {}, { 'a' }, squares_text() };
+    std::vector<uint8_t> runs, noise;
+    srand(42);
+    for (int i = 0; i < 100000; ++i) {
+        runs.push_back(static_cast<uint8_t>(i / 1000 % 3));
+        noise.push_back(static_cast<uint8_t>(rand()));
+    }
+    inputs.push_back(runs);
+    inputs.push_back(noise); // Needs stored blocks split at 64 KiB
+    for (const auto& input : inputs) {
+        const auto begin = input.data(), end = input.data() + input.size();
+        for (int level = 0; level <= 9; ++level) {
+            for (auto format : { stream_format::raw, stream_format::zlib, stream_format::gzip }) {
+                const auto compressed = compress(format, begin, end, level);
+                CHECK(decompress(format, compressed.data(), compressed.data() + compressed.size()) == input);
+            }
+        }
+    }
+
+    const auto text = squares_text();
+    const auto size1 = compress(stream_format::raw, text.data(), text.data() + text.size(), 1).size();
+    const auto size9 = compress(stream_format::raw, text.data(), text.data() + text.size(), 9).size();
+    CHECK(size9 <= size1 && size1 < text.size() / 2);
+    CHECK(compress(stream_format::raw, runs.data(), runs.data() + runs.size()).size() < 1000);
+    CHECK(compress(stream_format::raw, noise.data(), noise.data() + noise.size()).size() < noise.size() + noise.size() / 1000);
+
+    // A block ends where the symbol statistics change, so noise between text is stored and costs about as much as
+    // compressing the parts on their own
+    std::vector<uint8_t> mixed{text};
+    mixed.insert(mixed.end(), noise.begin(), noise.begin() + 10000);
+    mixed.insert(mixed.end(), text.rbegin(), text.rend());
+    auto size = [](const uint8_t* begin, const uint8_t* end, int level) { return compress(stream_format::raw, begin, end, level).size(); };
+    for (int level : { 1, 6, 9 }) {
+        const auto compressed = compress(stream_format::raw, mixed.data(), mixed.data() + mixed.size(), level);
+        CHECK(std::search(compressed.begin(), compressed.end(), noise.begin() + 2000, noise.begin() + 8000) != compressed.end());
+        const auto separate = 2 * size(text.data(), text.data() + text.size(), level) + size(noise.data(), noise.data() + 10000, level);
+        CHECK(compressed.size() < separate + 512);
+    }
+
+    // Continuing after a sync flush with the preceding data as history
+    const auto middle = text.data() + text.size() / 2;
+    deflater d{6};
+    std::vector<uint8_t> out;
+    d.compress(text.data(), text.data(), middle, false, out);
+    CHECK(out.size() >= 4 && out[out.size() - 4] == 0 && out[out.size() - 3] == 0 && out[out.size() - 2] == 0xff && out[out.size() - 1] == 0xff);
+    const auto first_size = out.size();
+    d.compress(text.data(), middle, text.data() + text.size(), true, out);
+    CHECK(decompress(stream_format::raw, out.data(), out.data() + out.size()) == text);
+    std::vector<uint8_t> independent;
+    deflater{6}.compress(middle, middle, text.data() + text.size(), true, independent);
+    CHECK(out.size() - first_size < independent.size());
+
+    // Input larger than the window size (a GiB by default) is searched a window at a time, with matches into the
+    // preceding data
+    for (size_t window_size : { 1, 1000, 4096 }) {
+        for (int level : { 1, 6 }) {
+            std::vector<uint8_t> windowed;
+            deflater{level, window_size}.compress(text.data(), text.data(), text.data() + text.size(), true, windowed);
+            CHECK(decompress(stream_format::raw, windowed.data(), windowed.data() + windowed.size()) == text);
+            if (window_size > 1) {
+                CHECK(windowed.size() < text.size() / 2);
+            }
+        }
+    }
+}
+
+void test_parallel_deflate()
+{
+    const auto text = squares_text();
+    std::vector<uint8_t> input;
+    srand(42);
+    for (int i = 0; i < 40; ++i) {
+        input.insert(input.end(), text.begin(), text.end());
+        for (int j = 0; j < 3000; ++j) input.push_back(static_cast<uint8_t>(rand() % 16));
+    }
+    const auto begin = input.data(), end = input.data() + input.size();
+    const auto sequential = compress(stream_format::gzip, begin, end);
+
+    for (int threads : { 1, 3 }) {
+        for (int chunk_size : { 1000, 40000, 1 << 20 }) {
+            const auto compressed = compress_parallel(begin, end, 6, threads, chunk_size);
+            CHECK(decompress(stream_format::gzip, compressed.data(), compressed.data() + compressed.size()) == input);
+            // Only the sync flushes and the matches chunks can't reach back for cost more
+            CHECK(compressed.size() < sequential.size() + sequential.size() / 10 + 6 * input.size() / chunk_size);
+        }
+        const auto empty = compress_parallel(begin, begin, 6, threads);
+        CHECK(decompress(stream_format::gzip, empty.data(), empty.data() + empty.size()).empty());
+    }
+
+    for (int level : { 0, 1, 9 }) {
+        const auto bgzf = compress_bgzf(begin, end, level, 3);
+        CHECK(decompress(stream_format::gzip, bgzf.data(), bgzf.data() + bgzf.size()) == input);
+        CHECK(decompress_parallel(bgzf.data(), bgzf.data() + bgzf.size(), 2) == input);
+        // Each member records its size, the last one is the standard end of file marker
+        size_t members = 0, pos = 0;
+        while (pos < bgzf.size()) {
+            CHECK(bgzf[pos + 3] == 4 && bgzf[pos + 12] == 'B' && bgzf[pos + 13] == 'C');
+            pos += 1 + (bgzf[pos + 16] | (bgzf[pos + 17] << 8));
+            ++members;
+        }
+        CHECK(pos == bgzf.size() && members == 1 + (input.size() + 0xfeff) / 0xff00);
+        const uint8_t eof_marker[28] = {
+            0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00,
+            0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        };
+        CHECK(std::equal(eof_marker, eof_marker + 28, bgzf.end() - 28));
+    }
+
+    // Split blocks that are all stored are merged, so a full member of segments over different alphabets isn't
+    // larger than a stored block and stays below the 64 KiB limit
+    std::vector<uint8_t> alternating;
+    for (int i = 0; i < 0xff00; ++i) {
+        alternating.push_back(static_cast<uint8_t>(i / 1024 % 2 * 48 + rand() % 208));
+    }
+    const auto alternating_end = alternating.data() + alternating.size();
+    CHECK(compress(stream_format::raw, alternating.data(), alternating_end).size() <= alternating.size() + 5);
+    const auto bgzf = compress_bgzf(alternating.data(), alternating_end, 6, 1);
+    CHECK(1 + (bgzf[16] | (bgzf[17] << 8)) == static_cast<int>(bgzf.size()) - 28);
+    CHECK(decompress_parallel(bgzf.data(), bgzf.data() + bgzf.size(), 2) == alternating);
+}
+
+void test_preset_dictionary()
+{
+    const std::string dictionary = R"({"user":{"id":,"name":"","email":""},"status":"active"})";
+    const std::string message    = R"({"user":{"id":42,"name":"ada","email":"ada@example.com"},"status":"active"})";
+    const auto dict_begin = reinterpret_cast<const uint8_t*>(dictionary.data()), dict_end = dict_begin + dictionary.size();
+    const auto begin = reinterpret_cast<const uint8_t*>(message.data()), end = begin + message.size();
+    const std::vector<uint8_t> input(begin, end);
+
+    // zlib's compress with the same dictionary
+    const std::vector<uint8_t> zlib_input{
+        0x78, 0xf9, 0xd2, 0x59, 0x11, 0x0c, 0xab, 0x46, 0xd1, 0x66, 0x62, 0x04, 0xd7, 0x98, 0x98, 0x92, 0x88, 0xa4, 0x17, 0xc8,
+        0x73, 0x48, 0xad, 0x48, 0xcc, 0x2d, 0xc8, 0x49, 0xd5, 0x4b, 0xce, 0xcf, 0xc5, 0x6a, 0x14, 0x00, 0x7b, 0x2d, 0x18, 0x57,
+    };
+    CHECK(decompress(stream_format::zlib, zlib_input.data(), zlib_input.data() + zlib_input.size(), dict_begin, dict_end) == input);
+
+    auto throws = [&](const std::vector<uint8_t>& compressed, const uint8_t* dictionary_begin, const uint8_t* dictionary_end) {
+        try {
+            if (dictionary_begin) {
+                decompress(stream_format::zlib, compressed.data(), compressed.data() + compressed.size(), dictionary_begin, dictionary_end);
+            } else {
+                decompress(stream_format::zlib, compressed.data(), compressed.data() + compressed.size());
+            }
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    CHECK(throws(zlib_input, nullptr, nullptr));
+    CHECK(throws(zlib_input, dict_begin, dict_end - 1));
+
+    for (int level : { 0, 1, 6, 9 }) {
+        for (auto format : { stream_format::raw, stream_format::zlib }) {
+            const auto compressed = compress(format, begin, end, dict_begin, dict_end, level);
+            CHECK(decompress(format, compressed.data(), compressed.data() + compressed.size(), dict_begin, dict_end) == input);
+            if (level) {
+                CHECK(compressed.size() < compress(format, begin, end, level).size() * 2 / 3);
+            }
+            if (format == stream_format::zlib) {
+                CHECK(compressed[1] & 0x20);
+                CHECK(std::equal(zlib_input.begin() + 2, zlib_input.begin() + 6, compressed.begin() + 2)); // DICTID
+            }
+        }
+    }
+
+    // Only the last 32 KiB, streamed a byte at a time
+    std::vector<uint8_t> long_dictionary(100000, 'x');
+    long_dictionary.insert(long_dictionary.end(), dict_begin, dict_end);
+    const auto compressed = compress(stream_format::zlib, begin, end, long_dictionary.data(), long_dictionary.data() + long_dictionary.size());
+    inflater inf{stream_format::zlib};
+    inf.set_dictionary(long_dictionary.data(), long_dictionary.data() + long_dictionary.size());
+    std::vector<uint8_t> output(input.size());
+    const uint8_t* in = compressed.data();
+    uint8_t* out = output.data();
+    for (size_t i = 0; i < compressed.size(); ++i) {
+        const auto st = inf.inflate(in, compressed.data() + i + 1, out, output.data() + output.size());
+        CHECK(st == (i + 1 == compressed.size() ? inflater::status::done : inflater::status::need_input));
+    }
+    CHECK(output == input);
+    CHECK(throws(compressed, dict_begin, dict_end));
+}
+
+void test_inflater_reuse()
+{
+    struct counting_allocator : allocator {
+        int    allocations = 0;
+        size_t live_bytes  = 0;
+        void* allocate(size_t size) override {
+            ++allocations;
+            live_bytes += size;
+            return malloc(size);
+        }
+        void deallocate(void* ptr, size_t size) override {
+            live_bytes -= size;
+            free(ptr);
+        }
+    } alloc;
+
+    {
+        output_buffer buf{alloc};
+        buf.enlarge();
+        buf.put('x');
+        buf.enlarge();
+        CHECK(alloc.allocations == 2 && buf.capacity() == 65536 && buf.data()[0] == 'x');
+    }
+    CHECK(alloc.live_bytes == 0);
+
+    const auto text = squares_text();
+    std::vector<std::vector<uint8_t>> inputs{ {}, text, std::vector<uint8_t>(text.begin(), text.begin() + 100) };
+    for (auto format : { stream_format::raw, stream_format::zlib, stream_format::gzip }) {
+        alloc.allocations = 0;
+        {
+            inflater inf{format, alloc};
+            CHECK(alloc.allocations == 1);
+            std::vector<uint8_t> output;
+            for (int round = 0; round < 2; ++round) {
+                for (const auto& input : inputs) {
+                    const auto compressed = compress(format, input.data(), input.data() + input.size());
+                    // Abandon a stream halfway
+                    const uint8_t* in = compressed.data();
+                    uint8_t* out = output.data();
+                    inf.inflate(in, compressed.data() + compressed.size() / 2, out, out);
+                    decompress(inf, compressed.data(), compressed.data() + compressed.size(), output);
+                    CHECK(output == input);
+                }
+            }
+            CHECK(alloc.allocations == 1);
+        }
+        CHECK(alloc.live_bytes == 0);
+    }
+}
+
+void test_file_io()
+{
+    const auto text = squares_text();
+    const auto compressed = compress(stream_format::gzip, text.data(), text.data() + text.size());
+
+    // In place output covers everything in chunks of at most the window
+    inflater inf{stream_format::gzip};
+    const uint8_t* in = compressed.data();
+    std::vector<uint8_t> output;
+    for (;;) {
+        const uint8_t* data;
+        size_t size;
+        const auto st = inf.inflate(in, compressed.data() + compressed.size(), data, size);
+        CHECK((st == inflater::status::need_output) == (size != 0) && size <= 65536);
+        output.insert(output.end(), data, data + size);
+        if (st == inflater::status::done) break;
+        CHECK(st == inflater::status::need_output);
+    }
+    CHECK(output == text);
+
+    const char* filename = "core_tests_file_io.tmp";
+    if (FILE* fp = fopen(filename, "wb")) {
+        CHECK(fwrite(compressed.data(), 1, compressed.size(), fp) == compressed.size());
+        fclose(fp);
+    }
+    {
+        const mapped_file file{filename};
+        CHECK(file.size() == compressed.size() && std::equal(file.begin(), file.end(), compressed.begin()));
+
+        FILE* out = tmpfile();
+        CHECK(out);
+        CHECK(decompress_to_fd(stream_format::gzip, file.begin(), file.end(), fileno(out)) == text.size());
+        rewind(out);
+        std::vector<uint8_t> written(text.size() + 1);
+        CHECK(fread(written.data(), 1, written.size(), out) == text.size());
+        written.pop_back();
+        CHECK(written == text);
+        fclose(out);
+    }
+    remove(filename);
+
+    bool thrown = false;
+    try {
+        mapped_file{filename};
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+void test_inflate_stats()
+{
+    const auto text = squares_text();
+    std::vector<uint8_t> input(text.begin(), text.end());
+    input.insert(input.end(), 70000, 'x'); // Enlarges deflate()'s output_buffer
+    std::vector<uint8_t> compressed;
+    deflater d;
+    d.compress(input.data(), input.data(), input.data() + 5000, false, compressed);
+    deflater{0}.compress(input.data(), input.data() + 5000, input.data() + 6000, false, compressed);
+    d.compress(input.data(), input.data() + 6000, input.data() + input.size(), true, compressed);
+
+    thread_inflate_stats() = {};
+    bit_stream bs{compressed.data(), compressed.data() + compressed.size()};
+    CHECK(deflate::deflate(bs) == input);
+    const auto& stats = thread_inflate_stats();
+    if (!inflate_stats_enabled) {
+        CHECK(stats.literals == 0 && stats.stored_blocks == 0 && stats.output_enlargements == 0);
+        return;
+    }
+    // The sync flushes are empty stored blocks
+    CHECK(stats.stored_blocks == 3 && stats.stored_bytes == 1000 && stats.dynamic_blocks + stats.fixed_blocks >= 2);
+    uint64_t match_bytes = 0, matches = 0, distances = 0;
+    for (int len = 0; len <= max_match_length; ++len) {
+        match_bytes += len * stats.length_histogram[len];
+        matches     += stats.length_histogram[len];
+    }
+    for (auto n : stats.distance_histogram) {
+        distances += n;
+    }
+    CHECK(matches == stats.matches && distances == stats.matches && stats.distance_histogram[0] > 0);
+    CHECK(stats.literals + match_bytes + stats.stored_bytes == input.size());
+    CHECK(stats.fast_path_symbols + stats.slow_path_symbols >= stats.literals + stats.matches);
+    CHECK(stats.output_enlargements >= 2 && stats.decode_ns >= stats.dynamic_header_ns);
+}
+
+void test_batch_inflate()
+{
+    const auto text = squares_text();
+    for (auto format : { stream_format::raw, stream_format::gzip }) {
+        std::vector<std::vector<uint8_t>> payloads, compressed;
+        size_t total = 0;
+        for (int i = 0; i < 40; ++i) {
+            const size_t size = i % 7 == 0 ? 0 : (i * 997) % 5000;
+            payloads.emplace_back(text.begin() + i * 100, text.begin() + i * 100 + size);
+            compressed.push_back(compress(format, payloads.back().data(), payloads.back().data() + size, i % 10));
+            total += size;
+        }
+        compressed[5].resize(compressed[5].size() / 2); // Truncated
+        compressed[11][0] |= format == stream_format::raw ? 0x06 : 0x80; // Reserved block type or gzip ID1
+        std::vector<batch_input> inputs;
+        for (const auto& c : compressed) {
+            inputs.push_back(batch_input{c.data(), c.data() + c.size()});
+        }
+
+        for (int threads : { 1, 3 }) {
+            for (size_t arena_size : { total, total / 2 }) {
+                std::vector<uint8_t> arena(arena_size + 1);
+                std::vector<batch_output> outputs;
+                const auto decoded = decompress_batch(format, inputs, arena.data(), arena.data() + arena_size, outputs, threads);
+                CHECK(outputs.size() == inputs.size());
+                size_t ok = 0, no_space = 0, used = 0;
+                std::vector<std::pair<size_t, size_t>> extents;
+                for (size_t i = 0; i < outputs.size(); ++i) {
+                    const auto& o = outputs[i];
+                    if (i == 5 || i == 11) {
+                        CHECK(o.status == batch_status::invalid);
+                    } else if (o.status == batch_status::ok) {
+                        CHECK(o.offset + o.size <= arena_size && std::equal(payloads[i].begin(), payloads[i].end(), arena.begin() + o.offset) && o.size == payloads[i].size());
+                        extents.emplace_back(o.offset, o.offset + o.size);
+                        ++ok;
+                        used += o.size;
+                    } else {
+                        CHECK(o.status == batch_status::no_space && o.size == 0);
+                        ++no_space;
+                    }
+                }
+                std::sort(extents.begin(), extents.end());
+                for (size_t i = 1; i < extents.size(); ++i) {
+                    CHECK(extents[i - 1].second <= extents[i].first);
+                }
+                CHECK(decoded == ok && ok + no_space == inputs.size() - 2);
+                if (arena_size == total && (threads == 1 || format == stream_format::gzip)) {
+                    CHECK(no_space == 0);
+                } else if (arena_size < total) {
+                    CHECK(no_space > 0 && used <= arena_size && used > arena_size / 2);
+                }
+            }
+        }
+
+        // Reusing one inflater across batches
+        inflater inf{format};
+        std::vector<uint8_t> arena(total);
+        std::vector<batch_output> outputs;
+        for (int round = 0; round < 2; ++round) {
+            CHECK(decompress_batch(inf, inputs, arena.data(), arena.data() + arena.size(), outputs) == inputs.size() - 2);
+            CHECK(outputs[39].offset + outputs[39].size <= total - payloads[5].size() - payloads[11].size());
+        }
+    }
+}
+
+void test_decode_into_span()
+{
+    const auto text = squares_text();
+    std::vector<uint8_t> runs(5000, 'a'); // Ends with a long match that exactly fills the output
+    runs[0] = 'b';
+    for (const auto& input : { text, runs }) {
+        for (auto format : { stream_format::raw, stream_format::zlib, stream_format::gzip }) {
+            const auto compressed = compress(format, input.data(), input.data() + input.size());
+            if (format == stream_format::gzip) {
+                CHECK(gzip_isize(compressed.data(), compressed.data() + compressed.size()) == input.size());
+            }
+            std::vector<uint8_t> out(input.size());
+            CHECK(decompress(format, compressed.data(), compressed.data() + compressed.size(), out.data(), out.data() + out.size()) == input.size());
+            CHECK(out == input);
+
+            bool threw = false;
+            try {
+                decompress(format, compressed.data(), compressed.data() + compressed.size(), out.data(), out.data() + out.size() - 1);
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            CHECK(threw);
+
+            threw = false;
+            try {
+                decompress(format, compressed.data(), compressed.data() + compressed.size() - 1, out.data(), out.data() + out.size());
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            CHECK(threw);
+        }
+    }
+
+    // Multiple gzip members decode back to back
+    auto members = compress(stream_format::gzip, text.data(), text.data() + 1000);
+    const auto second = compress(stream_format::gzip, runs.data(), runs.data() + runs.size());
+    members.insert(members.end(), second.begin(), second.end());
+    std::vector<uint8_t> out(1000 + runs.size());
+    CHECK(decompress(stream_format::gzip, members.data(), members.data() + members.size(), out.data(), out.data() + out.size()) == out.size());
+    CHECK(std::equal(text.begin(), text.begin() + 1000, out.begin()) && std::equal(runs.begin(), runs.end(), out.begin() + 1000));
+
+    bit_stream bs{members.data() + 10, members.data() + members.size()};
+    CHECK(deflate::deflate(bs, out.data(), out.data() + 1000) == 1000 && std::equal(text.begin(), text.begin() + 1000, out.begin()));
+}
+
+void test_error_codes()
+{
+    // Fields packed least significant bit first, Huffman codes as (code, -length), with some zero bytes after them
+    // so the error isn't that the input is truncated
+    auto pack = [](std::initializer_list<std::pair<uint32_t, int>> fields) {
+        std::vector<uint8_t> out;
+        uint64_t bits  = 0;
+        int      count = 0;
+        for (const auto& f : fields) {
+            const int n = f.second < 0 ? -f.second : f.second;
+            bits  |= static_cast<uint64_t>(f.second < 0 ? reversed_code(f.first, n) : f.first) << count;
+            count += n;
+            for (; count >= 8; count -= 8, bits >>= 8) {
+                out.push_back(static_cast<uint8_t>(bits));
+            }
+        }
+        out.push_back(static_cast<uint8_t>(bits));
+        out.resize(out.size() + 8);
+        return out;
+    };
+    auto error_of = [](stream_format format, const std::vector<uint8_t>& in) {
+        try {
+            decompress(format, in.data(), in.data() + in.size());
+        } catch (const deflate_error& e) {
+            CHECK(e.what() == std::string(error_message(e.code())));
+            return e.code();
+        }
+        CHECK(!"No error");
+        return error_code::truncated;
+    };
+
+    const auto raw = stream_format::raw;
+    CHECK(error_of(raw, pack({{1, 1}, {3, 2}})) == error_code::invalid_block_type);
+    CHECK(error_of(raw, pack({{1, 1}, {0, 2}, {0, 5}, {5, 16}, {0, 16}})) == error_code::invalid_stored_length);
+    CHECK(error_of(raw, pack({{1, 1}, {1, 2}, {0b11000110, -8}})) == error_code::invalid_symbol);               // Length 286
+    CHECK(error_of(raw, pack({{1, 1}, {1, 2}, {0b0000001, -7}, {30, -5}})) == error_code::invalid_symbol);      // Distance 30
+    CHECK(error_of(raw, pack({{1, 1}, {1, 2}, {0b0000001, -7}, {0, -5}})) == error_code::invalid_distance);     // Nothing to copy
+    CHECK(error_of(raw, pack({{1, 1}, {2, 2}, {0, 5}, {0, 5}, {0, 4}, {0, 12}})) == error_code::invalid_code_lengths);
+
+    const auto text = squares_text();
+    auto compressed = [&](stream_format format, void (*damage)(std::vector<uint8_t>&)) {
+        auto c = compress(format, text.data(), text.data() + text.size());
+        damage(c);
+        return c;
+    };
+    CHECK(error_of(raw, compressed(raw, [](std::vector<uint8_t>& c) { c.resize(c.size() / 2); })) == error_code::truncated);
+    CHECK(error_of(stream_format::gzip, compressed(stream_format::gzip, [](std::vector<uint8_t>& c) { c[1] = 0; })) == error_code::invalid_gzip_header);
+    CHECK(error_of(stream_format::gzip, compressed(stream_format::gzip, [](std::vector<uint8_t>& c) { c[c.size() - 8] ^= 1; })) == error_code::crc32_mismatch);
+    CHECK(error_of(stream_format::gzip, compressed(stream_format::gzip, [](std::vector<uint8_t>& c) { c[c.size() - 1] ^= 1; })) == error_code::isize_mismatch);
+    CHECK(error_of(stream_format::zlib, compressed(stream_format::zlib, [](std::vector<uint8_t>& c) { c[1] ^= 1; })) == error_code::invalid_zlib_header);
+    CHECK(error_of(stream_format::zlib, compressed(stream_format::zlib, [](std::vector<uint8_t>& c) { c[c.size() - 1] ^= 1; })) == error_code::adler32_mismatch);
+    CHECK(error_of(stream_format::zlib, compressed(stream_format::zlib, [](std::vector<uint8_t>& c) { c.pop_back(); })) == error_code::truncated);
+
+    const auto dict = compress(stream_format::zlib, text.data() + 100, text.data() + 200, text.data(), text.data() + 100);
+    CHECK(error_of(stream_format::zlib, dict) == error_code::dictionary_required);
+    try {
+        decompress(stream_format::zlib, dict.data(), dict.data() + dict.size(), text.data(), text.data() + 99);
+        CHECK(false);
+    } catch (const deflate_error& e) {
+        CHECK(e.code() == error_code::dictionary_mismatch);
+    }
+
+    const auto c = compress(raw, text.data(), text.data() + text.size());
+    std::vector<uint8_t> out(text.size() - 1);
+    try {
+        decompress(raw, c.data(), c.data() + c.size(), out.data(), out.data() + out.size());
+        CHECK(false);
+    } catch (const deflate_error& e) {
+        CHECK(e.code() == error_code::output_too_small);
+    }
+}
+
+void test_inflater_feed()
+{
+    // Input arriving in pieces, as from a socket, with two gzip members
+    const auto text = squares_text();
+    auto input = compress(stream_format::gzip, text.data(), text.data() + text.size() / 2);
+    const auto second = compress(stream_format::gzip, text.data() + text.size() / 2, text.data() + text.size());
+    input.insert(input.end(), second.begin(), second.end());
+
+    srand(42);
+    for (int iter = 0; iter < 20; ++iter) {
+        inflater copying{stream_format::gzip}, in_place{stream_format::gzip};
+        std::vector<uint8_t> copied, sunk;
+        for (size_t pos = 0; pos < input.size();) {
+            const size_t piece = std::min<size_t>(1 + rand() % (iter < 10 ? 16 : 4000), input.size() - pos);
+
+            for (size_t used = 0;;) {
+                uint8_t out[777];
+                const size_t out_size = 1 + rand() % sizeof(out);
+                const auto r = copying.feed(input.data() + pos + used, piece - used, out, out_size);
+                copied.insert(copied.end(), out, out + r.produced);
+                used += r.consumed;
+                CHECK(r.st == inflater::status::need_output ? r.produced == out_size : used == piece);
+                if (r.st != inflater::status::need_output) {
+                    break;
+                }
+            }
+
+            size_t produced = 0;
+            const auto r = in_place.feed(input.data() + pos, piece, [&](const uint8_t* data, size_t size) {
+                CHECK(size > 0);
+                sunk.insert(sunk.end(), data, data + size);
+                produced += size;
+            });
+            CHECK(r.consumed == piece && r.produced == produced && r.st != inflater::status::need_output);
+            pos += piece;
+        }
+        CHECK(copying.done() && in_place.done());
+        CHECK(copied == text && sunk == text);
+    }
+}
+
 int main()
 {
     try {
         test_crc32();
+        test_adler32();
         test_bit_stream();
+        test_bit_writer();
         test_huffman_tree();
         test_make_huffman_table();
+        test_decode_table();
+        test_code_lengths();
+        test_copy_match();
         test_deflate();
+        test_inflater();
+        test_stored_blocks();
+        test_stream_formats();
+        test_parallel_inflate();
+        test_speculative_inflate();
+        test_gzip_index();
+        test_deflater();
+        test_parallel_deflate();
+        test_preset_dictionary();
+        test_inflater_reuse();
+        test_file_io();
+        test_inflate_stats();
+        test_batch_inflate();
+        test_decode_into_span();
+        test_error_codes();
+        test_inflater_feed();
     } catch (const std::exception& e) {
         std::cerr << e.what() << "\n";
         return 1;
@@ -0,0 +1,215 @@
+// Fuzz target for the decoders: the first byte selects the format and chunk sizes, the rest is the stream. It checks
+// that malformed input is only ever reported as a deflate_error and that the one-shot, streaming and caller buffer
+// decoders agree, as do the parallel and speculative decoders and gzip_index (with small chunks) for gzip streams.
+//
+// Built with libFuzzer (clang) with -DDEFLATE_FUZZ=ON, otherwise as a standalone program that runs the files given
+// as arguments or, without arguments, mutations of a few generated streams (the fuzz_smoke test).
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "deflate.h"
+#include "deflate_error.h"
+#include "file_io.h"
+#include "gzip_index.h"
+#include "inflater.h"
+#include "parallel_inflate.h"
+#include "speculative_inflate.h"
+
+#define FUZZ_CHECK(expr) do { if (!(expr)) { std::cerr << #expr << std::endl; abort(); } } while (false)
+
+using namespace deflate;
+
+// Decode with inflater::inflate() in_chunk bytes of input and out_chunk bytes of output at a time. Returns false if
+// the stream doesn't end in the input.
+bool inflate_in_chunks(stream_format format, const uint8_t* begin, const uint8_t* end, size_t in_chunk, size_t out_chunk, std::vector<uint8_t>& output)
+{
+    inflater inf{format};
+    std::vector<uint8_t> buffer(out_chunk);
+    const uint8_t* in = begin;
+    for (;;) {
+        const auto in_end = in + std::min<size_t>(in_chunk, end - in);
+        uint8_t* out = buffer.data();
+        const auto st = inf.inflate(in, in_end, out, buffer.data() + buffer.size());
+        output.insert(output.end(), buffer.data(), out);
+        if (st == inflater::status::done && (format != stream_format::gzip || in == end)) {
+            // A gzip stream is only done after the last member
+            return true;
+        } else if (st == inflater::status::need_input && in == end) {
+            return false;
+        }
+    }
+}
+
+// Decode the gzip stream [begin, end) with the decoders that split it into chunk_size pieces, checking that they fail
+// exactly when decompress() did (ok) and otherwise produce its output
+void check_chunked_decoders(const uint8_t* begin, const uint8_t* end, int chunk_size, bool ok, const std::vector<uint8_t>& output)
+{
+    std::vector<uint8_t> parallel;
+    bool parallel_ok = false;
+    try {
+        parallel = decompress_parallel(begin, end, 2, chunk_size);
+        parallel_ok = true;
+    } catch (const deflate_error&) {
+    }
+    FUZZ_CHECK(ok == parallel_ok);
+    FUZZ_CHECK(!ok || parallel == output);
+
+    std::vector<uint8_t> speculative;
+    bool speculative_ok = false;
+    try {
+        speculative = decompress_speculative(begin, end, 2, chunk_size);
+        speculative_ok = true;
+    } catch (const deflate_error&) {
+    }
+    FUZZ_CHECK(ok == speculative_ok);
+    FUZZ_CHECK(!ok || speculative == output);
+
+    bool index_ok = false;
+    try {
+        const gzip_index index{begin, end, static_cast<uint64_t>(chunk_size)};
+        FUZZ_CHECK(index.uncompressed_size() == output.size());
+        std::vector<uint8_t> extracted(output.size());
+        FUZZ_CHECK(index.extract(begin, end, 0, extracted.data(), extracted.size()) == output.size());
+        FUZZ_CHECK(extracted == output);
+        const size_t offset = output.size() / 2;
+        FUZZ_CHECK(index.extract(begin, end, offset, extracted.data(), extracted.size()) == output.size() - offset);
+        FUZZ_CHECK(std::equal(output.begin() + offset, output.end(), extracted.begin()));
+        index_ok = true;
+    } catch (const deflate_error&) {
+    }
+    FUZZ_CHECK(ok == index_ok);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (!size) {
+        return 0;
+    }
+    const auto format = static_cast<stream_format>(data[0] % 3);
+    const size_t in_chunk  = 1 + ((data[0] >> 2) & 7) * 97;
+    const size_t out_chunk = 1 + ((data[0] >> 5) & 7) * 1031;
+    const int chunk_size   = 64 << (((data[0] >> 2) & 7) % 7);
+    const uint8_t* begin = data + 1;
+    const uint8_t* end   = data + size;
+
+    std::vector<uint8_t> output;
+    bool ok = false;
+    try {
+        output = decompress(format, begin, end);
+        ok = true;
+    } catch (const deflate_error&) {
+    }
+
+    std::vector<uint8_t> streamed;
+    bool streamed_ok = false;
+    try {
+        streamed_ok = inflate_in_chunks(format, begin, end, in_chunk, out_chunk, streamed);
+    } catch (const deflate_error&) {
+    }
+    FUZZ_CHECK(ok == streamed_ok);
+    FUZZ_CHECK(!ok || streamed == output);
+    if (format == stream_format::gzip) {
+        check_chunked_decoders(begin, end, chunk_size, ok, output);
+    }
+
+    if (ok) {
+        std::vector<uint8_t> buffer(output.size());
+        FUZZ_CHECK(decompress(format, begin, end, buffer.data(), buffer.data() + buffer.size()) == output.size());
+        FUZZ_CHECK(buffer == output);
+        if (!output.empty()) {
+            try {
+                decompress(format, begin, end, buffer.data(), buffer.data() + buffer.size() - 1);
+                FUZZ_CHECK(!"Output too large for the buffer");
+            } catch (const deflate_error& e) {
+                FUZZ_CHECK(e.code() == error_code::output_too_small);
+            }
+        }
+    } else {
+        std::vector<uint8_t> buffer(std::min<size_t>(gzip_isize(begin, end), 1 << 20));
+        try {
+            decompress(format, begin, end, buffer.data(), buffer.data() + buffer.size());
+        } catch (const deflate_error&) {
+        }
+    }
+    return 0;
+}
+
+#ifndef DEFLATE_LIBFUZZER
+// Damage one of the seed streams a few times: flip bits, overwrite or duplicate bytes, truncate
+std::vector<uint8_t> mutate(const std::vector<uint8_t>& seed, std::mt19937& rng)
+{
+    std::vector<uint8_t> s = seed;
+    const int mutations = 1 + rng() % 4;
+    for (int i = 0; i < mutations && s.size() > 1; ++i) {
+        const size_t pos = 1 + rng() % (s.size() - 1);
+        switch (rng() % 4) {
+        case 0:
+            s[pos] ^= static_cast<uint8_t>(1 << (rng() % 8));
+            break;
+        case 1:
+            s[pos] = static_cast<uint8_t>(rng());
+            break;
+        case 2: {
+            const size_t len = std::min<size_t>(1 + rng() % 16, s.size() - pos);
+            const std::vector<uint8_t> copy(s.begin() + pos, s.begin() + pos + len);
+            s.insert(s.begin() + 1 + rng() % (s.size() - 1), copy.begin(), copy.end());
+            break;
+        }
+        case 3:
+            s.resize(pos);
+            break;
+        }
+    }
+    return s;
+}
+
+std::vector<std::vector<uint8_t>> make_seeds()
+{
+    std::vector<uint8_t> text;
+    for (int i = 0; text.size() < 3000; ++i) {
+        const auto line = std::to_string(i) + " squared is " + std::to_string(i * i) + "\n";
+        text.insert(text.end(), line.begin(), line.end());
+    }
+    std::vector<std::vector<uint8_t>> seeds;
+    for (int f = 0; f < 3; ++f) {
+        for (int level : { 0, 1, 6, 9 }) {
+            for (size_t size : { size_t{0}, size_t{40}, text.size() }) {
+                const auto c = compress(static_cast<stream_format>(f), text.data(), text.data() + size, level);
+                std::vector<uint8_t> seed{static_cast<uint8_t>(f)};
+                seed.insert(seed.end(), c.begin(), c.end());
+                seeds.push_back(seed);
+            }
+        }
+    }
+    return seeds;
+}
+
+int main(int argc, char* argv[])
+{
+    try {
+        if (argc > 1) {
+            for (int i = 1; i < argc; ++i) {
+                const mapped_file input{argv[i]};
+                LLVMFuzzerTestOneInput(input.begin(), input.size());
+            }
+            return 0;
+        }
+        const auto seeds = make_seeds();
+        std::mt19937 rng{42};
+        for (int i = 0; i < 20000; ++i) {
+            auto input = mutate(seeds[i % seeds.size()], rng);
+            input[0] = static_cast<uint8_t>((input[0] % 3) | (rng() & 0xfc));
+            LLVMFuzzerTestOneInput(input.data(), input.size());
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+#endif
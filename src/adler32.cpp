@@ -0,0 +1,34 @@
+#include "adler32.h"
+#include <stddef.h>
+#include <algorithm>
+
+namespace deflate {
+
+constexpr uint32_t adler32_base = 65521; // largest prime smaller than 65536
+// Largest n such that 255n(n+1)/2 + (n+1)(adler32_base-1) fits in 32 bits, so the sums only have to be reduced
+// every adler32_nmax bytes
+constexpr int adler32_nmax = 5552;
+
+uint32_t update_adler32(uint32_t adler, const uint8_t* beg, const uint8_t* end)
+{
+    uint32_t s1 = adler & 0xffff;
+    uint32_t s2 = adler >> 16;
+    for (auto p = beg; p != end;) {
+        const auto chunk_end = p + std::min<ptrdiff_t>(end - p, adler32_nmax);
+        for (; chunk_end - p >= 4; p += 4) {
+            s1 += p[0]; s2 += s1;
+            s1 += p[1]; s2 += s1;
+            s1 += p[2]; s2 += s1;
+            s1 += p[3]; s2 += s1;
+        }
+        for (; p != chunk_end; ++p) {
+            s1 += *p;
+            s2 += s1;
+        }
+        s1 %= adler32_base;
+        s2 %= adler32_base;
+    }
+    return (s2 << 16) | s1;
+}
+
+} // namespace deflate
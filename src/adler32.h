@@ -0,0 +1,13 @@
+#ifndef DEFLATE_ADLER32_H
+#define DEFLATE_ADLER32_H
+
+#include <stdint.h>
+
+namespace deflate {
+
+// Adler-32 checksum (rfc1950 8.2), start with 1
+uint32_t update_adler32(uint32_t adler, const uint8_t* beg, const uint8_t* end);
+
+} // namespace deflate
+
+#endif
@@ -0,0 +1,25 @@
+#include "allocator.h"
+#include <stdlib.h>
+
+namespace deflate {
+
+class malloc_allocator final : public allocator {
+public:
+    void* allocate(size_t size) override {
+        return malloc(size);
+    }
+
+    void deallocate(void* ptr, size_t) override {
+        free(ptr);
+    }
+};
+
+// Constant initialized, so usable during static initialization
+malloc_allocator the_default_allocator;
+
+allocator& default_allocator()
+{
+    return the_default_allocator;
+}
+
+} // namespace deflate
@@ -0,0 +1,26 @@
+#ifndef DEFLATE_ALLOCATOR_H
+#define DEFLATE_ALLOCATOR_H
+
+#include <stddef.h>
+
+namespace deflate {
+
+// Source of the buffers of output_buffer and inflater, e.g. a per-request arena. Must outlive its users.
+class allocator {
+public:
+    // Returns nullptr on failure
+    virtual void* allocate(size_t size) = 0;
+
+    // ptr is a block of size bytes from allocate()
+    virtual void deallocate(void* ptr, size_t size) = 0;
+
+protected:
+    ~allocator() = default;
+};
+
+// Allocator using malloc() and free()
+allocator& default_allocator();
+
+} // namespace deflate
+
+#endif
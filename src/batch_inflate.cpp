@@ -0,0 +1,117 @@
+#include "batch_inflate.h"
+#include "parallel_for.h"
+#include "deflate.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+namespace deflate {
+
+// Decode input into [out, out_end) storing the result in output (with offsets relative to arena)
+void inflate_payload(inflater& inf, const batch_input& input, const uint8_t* arena, uint8_t* out, uint8_t* out_end, batch_output& output)
+{
+    output = batch_output{0, 0, batch_status::invalid};
+    inf.reset();
+    const uint8_t* in = input.begin;
+    uint8_t* const out_begin = out;
+    try {
+        const auto st = inf.inflate(in, input.end, out, out_end);
+        if (st == inflater::status::done) {
+            output = batch_output{static_cast<size_t>(out_begin - arena), static_cast<size_t>(out - out_begin), batch_status::ok};
+        } else if (st == inflater::status::need_output) {
+            output.status = batch_status::no_space;
+        }
+    } catch (const std::runtime_error&) {
+    }
+}
+
+// Decode inputs [first, last) one after the other into [pos, end), returning the new position
+uint8_t* inflate_payloads(inflater& inf, const std::vector<batch_input>& inputs, size_t first, size_t last, const uint8_t* arena, uint8_t* pos, uint8_t* end, std::vector<batch_output>& outputs)
+{
+    for (size_t i = first; i < last; ++i) {
+        inflate_payload(inf, inputs[i], arena, pos, end, outputs[i]);
+        if (outputs[i].status == batch_status::ok) {
+            pos += outputs[i].size;
+        }
+    }
+    return pos;
+}
+
+size_t count_decoded(const std::vector<batch_output>& outputs)
+{
+    return std::count_if(outputs.begin(), outputs.end(), [](const batch_output& o) { return o.status == batch_status::ok; });
+}
+
+size_t decompress_batch(inflater& inf, const std::vector<batch_input>& inputs, uint8_t* arena, uint8_t* arena_end, std::vector<batch_output>& outputs)
+{
+    outputs.resize(inputs.size());
+    inflate_payloads(inf, inputs, 0, inputs.size(), arena, arena, arena_end, outputs);
+    return count_decoded(outputs);
+}
+
+// Expected output size of an input, used to share out the arena
+uint64_t payload_weight(stream_format format, const batch_input& input)
+{
+    const auto isize = format == stream_format::gzip ? gzip_isize(input.begin, input.end) : 0;
+    return isize ? isize : input.end - input.begin;
+}
+
+size_t decompress_batch(stream_format format, const std::vector<batch_input>& inputs, uint8_t* arena, uint8_t* arena_end, std::vector<batch_output>& outputs, int num_threads)
+{
+    if (num_threads <= 0) {
+        num_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    const auto count      = inputs.size();
+    const int  num_groups = static_cast<int>(std::min<size_t>(num_threads, count));
+    if (num_groups <= 1) {
+        inflater inf{format};
+        return decompress_batch(inf, inputs, arena, arena_end, outputs);
+    }
+    outputs.resize(count);
+
+    // Split into runs of payloads of about the same weight, giving each its weight's share of the arena (at least
+    // the weight itself if everything fits)
+    std::vector<uint64_t> weights(count + 1, 0);
+    for (size_t i = 0; i < count; ++i) {
+        weights[i + 1] = weights[i] + payload_weight(format, inputs[i]);
+    }
+    const uint64_t total_weight = std::max<uint64_t>(weights[count], 1);
+    const uint64_t arena_size   = arena_end - arena;
+    struct group {
+        size_t   first, last;
+        uint8_t* begin;
+        uint8_t* pos; // End of the output so far
+        uint8_t* end;
+    };
+    std::vector<group> groups(num_groups);
+    size_t first = 0;
+    for (int g = 0; g < num_groups; ++g) {
+        size_t last = g + 1 == num_groups ? count : first + 1;
+        while (last < count - (num_groups - g - 1) && weights[last] * num_groups < total_weight * (g + 1)) {
+            ++last;
+        }
+        const auto share = [&](size_t i) { return arena + static_cast<size_t>(static_cast<double>(arena_size) * weights[i] / total_weight); };
+        groups[g] = group{first, last, share(first), share(first), g + 1 == num_groups ? arena_end : share(last)};
+        first = last;
+    }
+
+    parallel_for(num_groups, num_threads, [&](int g) {
+        inflater inf{format};
+        auto& gr = groups[g];
+        gr.pos = inflate_payloads(inf, inputs, gr.first, gr.last, arena, gr.begin, gr.end, outputs);
+    });
+
+    // Retry what didn't fit where the most space is left
+    inflater inf{format};
+    for (size_t i = 0; i < count; ++i) {
+        if (outputs[i].status != batch_status::no_space) {
+            continue;
+        }
+        auto& gr = *std::max_element(groups.begin(), groups.end(), [](const group& l, const group& r) { return l.end - l.pos < r.end - r.pos; });
+        gr.pos = inflate_payloads(inf, inputs, i, i + 1, arena, gr.pos, gr.end, outputs);
+    }
+    return count_decoded(outputs);
+}
+
+} // namespace deflate
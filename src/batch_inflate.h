@@ -0,0 +1,43 @@
+#ifndef DEFLATE_BATCH_INFLATE_H
+#define DEFLATE_BATCH_INFLATE_H
+
+#include "inflater.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace deflate {
+
+// A complete compressed payload
+struct batch_input {
+    const uint8_t* begin;
+    const uint8_t* end;
+};
+
+enum class batch_status {
+    ok,
+    invalid,  // Invalid or truncated
+    no_space, // The output didn't fit in the arena space available to it
+};
+
+struct batch_output {
+    size_t       offset; // Of the payload's output in the arena
+    size_t       size;
+    batch_status status; // For anything but ok, offset and size are 0
+};
+
+// Decompress many small independent payloads into the arena [arena, arena_end) with inf (reset() for each),
+// allocating nothing. Outputs are placed one after the other in input order, skipping those that don't fit. outputs
+// is resized to inputs.size(). Returns the number of payloads decoded successfully.
+size_t decompress_batch(inflater& inf, const std::vector<batch_input>& inputs, uint8_t* arena, uint8_t* arena_end, std::vector<batch_output>& outputs);
+
+// Like the above using num_threads threads (0 for one per core), each with its own inflater decoding a run of
+// consecutive payloads into its share of the arena. The shares follow the gzip ISIZE fields, or otherwise the
+// compressed sizes, and payloads that don't fit in their share are retried in the space left over in the others, so
+// there may be gaps between outputs.
+size_t decompress_batch(stream_format format, const std::vector<batch_input>& inputs, uint8_t* arena, uint8_t* arena_end, std::vector<batch_output>& outputs, int num_threads = 0);
+
+} // namespace deflate
+
+#endif
@@ -2,7 +2,10 @@
 #define DEFLATE_BIT_STREAM_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
 #include <cassert>
+#include <algorithm>
 
 namespace deflate {
 /*
@@ -18,31 +21,119 @@ significant bit of the code.
 
 class bit_stream {
 public:
-    explicit bit_stream(const uint8_t* begin, const uint8_t* end) : data_(begin), len_(static_cast<int>(end - begin)) {
+    explicit bit_stream(const uint8_t* begin, const uint8_t* end) : data_(begin), len_(end - begin) {
     }
 
     template<int size>
     explicit bit_stream(const uint8_t (&data)[size]) : data_(data), len_(size) {
     }
 
+    // Continue reading at begin with bits left over from a previous bit_stream (see buffered_bits())
+    explicit bit_stream(const uint8_t* begin, const uint8_t* end, uint64_t bits, int avail) : data_(begin), len_(end - begin), bits_(bits), avail_(avail) {
+        assert(avail >= 0 && avail <= 64 && (avail == 64 || (bits >> avail) == 0));
+    }
+
+    static constexpr int max_ensure_bits = 56;
+
+    // Reading past the end of the input supplies zero bits (see overrun())
     void ensure_bits(int num_bits) {
-        assert(num_bits > 0 && num_bits <= 16);
-        while (avail_ < num_bits) {
-            assert(pos_ < len_);
-            const auto b = data_[pos_++];
-            bits_   = (static_cast<uint32_t>(b) << avail_) | bits_;
+        assert(num_bits > 0 && num_bits <= max_ensure_bits);
+        if (avail_ >= num_bits) {
+            return;
+        }
+        if (len_ - pos_ >= 8) {
+            // Load 8 bytes and keep as many whole bytes as fit. Bits above avail_ may then hold the start of the
+            // byte at pos_, which is harmless as it's or'ed in at the same position when it's loaded again.
+            bits_  |= load_le64(data_ + pos_) << avail_;
+            pos_   += (63 - avail_) >> 3;
+            avail_ |= 56;
+        } else {
+            refill_near_end(num_bits);
+        }
+    }
+
+    // Have any of the zero bits supplied past the end of the input been consumed?
+    bool overrun() const {
+        return padding_bits() > avail_;
+    }
+
+    // Remove the zero bits supplied past the end of the input from the bit buffer
+    void remove_padding() {
+        assert(!overrun());
+        if (pos_ > len_) {
+            avail_ -= padding_bits();
+            pos_    = len_;
+        }
+    }
+
+    // Move all remaining input into the bit buffer (which must have room for it)
+    void buffer_remaining_input() {
+        remove_padding();
+        assert(avail_ + 8 * (len_ - pos_) <= 64);
+        while (pos_ < len_) {
+            bits_  |= static_cast<uint64_t>(data_[pos_++]) << avail_;
             avail_ += 8;
         }
     }
 
+    // Skip to the next byte boundary
+    void align_to_byte() {
+        if (avail_ % 8) {
+            consume_bits(avail_ % 8);
+        }
+    }
+
+    // Copy up to n bytes (must be byte aligned) first from the bit buffer then directly from the input, returning the
+    // number of bytes copied, which is less than n only if the input has been exhausted
+    int read_bytes(uint8_t* dst, int n) {
+        remove_padding();
+        assert(avail_ % 8 == 0);
+        int copied = 0;
+        while (copied < n && avail_) {
+            dst[copied++] = static_cast<uint8_t>(bits_);
+            bits_  >>= 8;
+            avail_  -= 8;
+        }
+        if (copied < n) {
+            // The bit buffer is empty, don't leave anything from the bytes skipped by memcpy behind in it
+            bits_ = 0;
+            const auto m = static_cast<int>(std::min<ptrdiff_t>(n - copied, len_ - pos_));
+            memcpy(dst + copied, data_ + pos_, m);
+            pos_   += m;
+            copied += m;
+        }
+        return copied;
+    }
+
+    // Number of input bytes not yet moved into the bit buffer
+    ptrdiff_t remaining_bytes() const {
+        return len_ - pos_;
+    }
+
+    // Number of bits consumed from the start of the input (negative while bits carried over into the constructor
+    // remain)
+    int64_t bit_position() const {
+        return 8 * static_cast<int64_t>(pos_) - avail_;
+    }
+
+    // Next input byte not yet moved into the bit buffer
+    const uint8_t* position() const {
+        assert(pos_ <= len_);
+        return data_ + pos_;
+    }
+
+    uint64_t buffered_bits() const {
+        return avail_ < 64 ? bits_ & ((static_cast<uint64_t>(1) << avail_) - 1) : bits_;
+    }
+
     int potentially_available_bits() const {
         const auto remaining = len_ - pos_;
-        return remaining >= 2 ? 16 : avail_ + 8 * remaining;
+        return remaining >= 2 ? 16 : avail_ + 8 * static_cast<int>(remaining);
     }
 
     uint32_t peek_bits(int num_bits) {
-        assert(num_bits > 0 && num_bits <= avail_);
-        return bits_ & ((1 << num_bits) - 1);
+        assert(num_bits > 0 && num_bits <= 32 && num_bits <= avail_);
+        return static_cast<uint32_t>(bits_ & ((static_cast<uint64_t>(1) << num_bits) - 1));
     }
 
     void consume_bits(int num_bits) {
@@ -68,10 +159,41 @@ public:
 
 private:
     const uint8_t*  data_;
-    int             len_;
-    int             pos_   = 0;
-    uint32_t        bits_  = 0;
+    ptrdiff_t       len_;
+    ptrdiff_t       pos_   = 0;
+    uint64_t        bits_  = 0;
     int             avail_ = 0;
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Warray-bounds" // Not smart enough to see that short inputs take refill_near_end()
+#endif
+    static uint64_t load_le64(const uint8_t* p) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        v = __builtin_bswap64(v);
+#endif
+        return v;
+    }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+    void refill_near_end(int num_bits) {
+        while (avail_ <= max_ensure_bits && pos_ < len_) {
+            bits_  |= static_cast<uint64_t>(data_[pos_++]) << avail_;
+            avail_ += 8;
+        }
+        while (avail_ < num_bits) {
+            ++pos_;
+            avail_ += 8;
+        }
+    }
+
+    int padding_bits() const {
+        return pos_ > len_ ? 8 * static_cast<int>(pos_ - len_) : 0;
+    }
 };
 
 } // namespace deflate
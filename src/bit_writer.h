@@ -0,0 +1,99 @@
+#ifndef DEFLATE_BIT_WRITER_H
+#define DEFLATE_BIT_WRITER_H
+
+#include "huffman_code.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <cassert>
+#include <algorithm>
+#include <vector>
+
+namespace deflate {
+
+// Packs fields the way bit_stream reads them: starting with the least significant bit of the next byte, with
+// Huffman codes written most significant bit first (so they're stored bit reversed).
+//
+// Bits are collected in a 64-bit accumulator by add_bits() and moved to the output by flush_bits() with a single
+// unaligned 8-byte store, which requires reserve() to have made room for them first.
+class bit_writer {
+public:
+    // Append to out
+    explicit bit_writer(std::vector<uint8_t>& out) : out_(out), pos_(out.size()) {
+    }
+
+    // Make room for writing num_bytes more bytes
+    void reserve(size_t num_bytes) {
+        const auto needed = pos_ + num_bytes + 8;
+        if (out_.size() < needed) {
+            out_.resize(std::max(needed, 2 * out_.size()));
+        }
+    }
+
+    // At most 64 bits can be pending, up to 7 remain after flush_bits()
+    void add_bits(uint64_t value, int num_bits) {
+        assert(num_bits >= 0 && count_ + num_bits <= 64 && (num_bits == 64 || (value >> num_bits) == 0));
+        bits_  |= value << count_;
+        count_ += num_bits;
+    }
+
+    // c.value must be bit reversed (see reversed_code())
+    void add_code(const huffman_code& c) {
+        assert(c.len);
+        add_bits(c.value, c.len);
+    }
+
+    // Write out the pending whole bytes
+    void flush_bits() {
+        assert(pos_ + 8 <= out_.size());
+        store_le64(out_.data() + pos_, bits_);
+        const int n = count_ >> 3;
+        pos_   += n;
+        bits_   = n == 8 ? 0 : bits_ >> (8 * n);
+        count_ &= 7;
+    }
+
+    // Pad with zero bits to the next byte boundary
+    void align_to_byte() {
+        count_ = (count_ + 7) & ~7;
+        flush_bits();
+    }
+
+    // Copy bytes to the (byte aligned) output
+    void put_bytes(const uint8_t* data, size_t n) {
+        assert(count_ == 0);
+        reserve(n);
+        if (n) {
+            memcpy(out_.data() + pos_, data, n);
+        }
+        pos_ += n;
+    }
+
+    int pending_bits() const {
+        return count_;
+    }
+
+    // Pad to a byte boundary and trim the output to the bytes written
+    void finish() {
+        reserve(0);
+        align_to_byte();
+        out_.resize(pos_);
+    }
+
+private:
+    std::vector<uint8_t>& out_;
+    size_t                pos_;
+    uint64_t              bits_  = 0;
+    int                   count_ = 0;
+
+    static void store_le64(uint8_t* p, uint64_t v) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        v = __builtin_bswap64(v);
+#endif
+        memcpy(p, &v, sizeof(v));
+    }
+};
+
+} // namespace deflate
+
+#endif
@@ -0,0 +1,413 @@
+#include "block_decoder.h"
+#include "deflate_alphabet.h"
+#include "inflate_stats.h"
+#include "deflate_error.h"
+
+#include <algorithm>
+
+namespace deflate {
+
+enum class block_type { uncompressed, fixed_huffman, dynamic_huffman, reserved };
+
+// Undo a step that ran past the end of the input. Everything after saved is known to fit in the bit buffer (no
+// step needs more than max_sequence_bits) so the rest of the input is moved there to be continued with the next
+// bit_stream.
+block_decoder::status need_more_input(bit_stream& bs, const bit_stream& saved)
+{
+    bs = saved;
+    bs.buffer_remaining_input();
+    return block_decoder::status::need_input;
+}
+
+block_decoder::status block_decoder::decode(bit_stream& bs, output_buffer& output, bool stop_at_block_end)
+{
+    DEFLATE_STAT_TIMER(decode_ns);
+    for (;;) {
+        switch (state_) {
+        case state::block_header: {
+            // Block header bits
+            const auto saved  = bs;
+            const auto header = bs.get_bits(3);
+            if (bs.overrun()) {
+                return need_more_input(bs, saved);
+            }
+            last_block_ = !!(header & 1);
+            const auto type = static_cast<block_type>(header >> 1);
+            if (type == block_type::dynamic_huffman) {
+                DEFLATE_STAT(++thread_inflate_stats().dynamic_blocks);
+                state_ = state::dynamic_header;
+            } else if (type == block_type::fixed_huffman) {
+                DEFLATE_STAT(++thread_inflate_stats().fixed_blocks);
+                cur_lit_len_table_ = &fixed_lit_len_decode_table;
+                cur_dist_table_    = &fixed_dist_decode_table;
+                state_ = state::codes;
+            } else if (type == block_type::uncompressed) {
+                DEFLATE_STAT(++thread_inflate_stats().stored_blocks);
+                state_ = state::stored_header;
+            } else {
+                throw_deflate_error(error_code::invalid_block_type);
+            }
+            break;
+        }
+        case state::stored_header:
+            if (decode_stored_header(bs) == status::need_input) {
+                return status::need_input;
+            }
+            state_ = state::stored_data;
+            break;
+        case state::stored_data: {
+            const auto st = decode_stored_data(bs, output);
+            if (st != status::done) {
+                return st;
+            }
+            state_ = last_block_ ? state::done : state::block_header;
+            if (stop_at_block_end) {
+                return status::done;
+            }
+            break;
+        }
+        case state::dynamic_header:
+        case state::code_length_codes:
+        case state::code_lengths:
+            if (decode_dynamic_header(bs) == status::need_input) {
+                return status::need_input;
+            }
+            state_ = state::codes;
+            break;
+        case state::codes: {
+            const auto st = decode_codes(bs, output);
+            if (st != status::done) {
+                return st;
+            }
+            state_ = last_block_ ? state::done : state::block_header;
+            if (stop_at_block_end) {
+                return status::done;
+            }
+            break;
+        }
+        case state::done:
+            return status::done;
+        }
+    }
+}
+
+block_decoder::status block_decoder::decode_stored_header(bit_stream& bs)
+{
+    // skip any remaining bits in current partially
+    //     processed byte
+    //     read LEN and NLEN (each 16-bits)
+    const auto saved = bs;
+    bs.align_to_byte();
+    const auto len  = bs.get_bits(16);
+    const auto nlen = bs.get_bits(16);
+    if (bs.overrun()) {
+        return need_more_input(bs, saved);
+    }
+    if ((len ^ nlen) != 0xffff) {
+        throw_deflate_error(error_code::invalid_stored_length);
+    }
+    stored_remaining_ = static_cast<int>(len);
+    return status::done;
+}
+
+// Returns status::done when the whole block has been copied
+block_decoder::status block_decoder::decode_stored_data(bit_stream& bs, output_buffer& output)
+{
+    // copy LEN bytes of data to output
+    while (stored_remaining_) {
+        const int n = static_cast<int>(std::min<ptrdiff_t>(stored_remaining_, output.avail()));
+        if (!n) {
+            return status::need_output;
+        }
+        const int copied = bs.read_bytes(output.end(), n);
+        DEFLATE_STAT(thread_inflate_stats().stored_bytes += copied);
+        output.commit(output.end() + copied);
+        stored_remaining_ -= copied;
+        if (copied < n) {
+            return status::need_input;
+        }
+    }
+    return status::done;
+}
+
+block_decoder::status block_decoder::decode_dynamic_header(bit_stream& bs)
+{
+    DEFLATE_STAT_TIMER(dynamic_header_ns);
+    if (state_ == state::dynamic_header) {
+        // read representation of code trees
+        const auto saved = bs;
+        const int hlit  = 257 + bs.get_bits(5);     // 5 Bits: HLIT, # of Literal/Length codes - 257 (257 - 286)
+        const int hdist = 1 + bs.get_bits(5);       // 5 Bits: HDIST, # of Distance codes - 1        (1 - 32)
+        const int hclen = 4 + bs.get_bits(4);       // 4 Bits: HCLEN, # of Code Length codes - 4     (4 - 19)
+        if (bs.overrun()) {
+            return need_more_input(bs, saved);
+        }
+        hlit_  = hlit;
+        hdist_ = hdist;
+        hclen_ = hclen;
+        index_ = 0;
+        memset(code_lengths_, 0, max_code_length_codes);
+        state_ = state::code_length_codes;
+    }
+
+    if (state_ == state::code_length_codes) {
+        for (; index_ < hclen_; ++index_) {
+            const auto saved = bs;
+            const auto len   = static_cast<uint8_t>(bs.get_bits(3));
+            if (bs.overrun()) {
+                return need_more_input(bs, saved);
+            }
+            code_lengths_[code_length_order[index_]] = len;
+        }
+        if (!cl_table_.build(code_lengths_, max_code_length_codes, decode_table::alphabet::code_length, 7)) {
+            throw_deflate_error(error_code::invalid_code_lengths);
+        }
+        index_ = 0;
+        state_ = state::code_lengths;
+    }
+
+    assert(state_ == state::code_lengths);
+    const int num_code_lengths = hlit_ + hdist_;
+    while (index_ < num_code_lengths) {
+        const auto saved = bs;
+        const int next   = decode_code_length(cl_table_, bs, code_lengths_, index_, num_code_lengths);
+        if (bs.overrun()) {
+            return need_more_input(bs, saved);
+        }
+        if (next < 0) {
+            throw_deflate_error(error_code::invalid_code_lengths);
+        }
+        index_ = next;
+    }
+
+    if (!build_dynamic_tables(code_lengths_, hlit_, hdist_, lit_len_table_, dist_table_)) {
+        throw_deflate_error(error_code::invalid_code_lengths);
+    }
+    cur_lit_len_table_ = &lit_len_table_;
+    cur_dist_table_    = &dist_table_;
+    return status::done;
+}
+
+int decode_code_length(const decode_table& cl_table, bit_stream& bs, uint8_t* lengths, int index, int num_lengths)
+{
+    bs.ensure_bits(max_bits + 7);
+    const auto e = cl_table.lookup(bs.peek_bits(max_bits));
+    bs.consume_bits(e.code_len());
+    const int symbol = e.is_invalid() ? num_code_length_codes : e.value();
+    int count = 1;
+    if (symbol == 16) {
+        count = 3 + bs.get_bits(2);
+    } else if (symbol == 17) {
+        count = 3 + bs.get_bits(3);
+    } else if (symbol == 18) {
+        count = 11 + bs.get_bits(7);
+    }
+    if (bs.overrun()) {
+        return index;
+    }
+
+    uint8_t cl_val = 0;
+    if (symbol <= 15) {
+        // 0 - 15: Represent code lengths of 0 - 15
+        cl_val = static_cast<uint8_t>(symbol);
+    } else if (symbol == 16) {
+        // 16: Copy the previous code length 3 - 6 times.
+        if (index == 0) {
+            return -1;
+        }
+        cl_val = lengths[index-1];
+        // The next 2 bits indicate repeat length
+        // (0 = 3, ... , 3 = 6)
+        // Example:  Codes 8, 16 (+2 bits 11),
+        // 16 (+2 bits 10) will expand to
+        // 12 code lengths of 8 (1 + 6 + 5)
+    } else if (symbol == 17) {
+        // 17: Repeat a code length of 0 for 3 - 10 times.
+        // (3 bits of length)
+    } else if (symbol == 18) {
+        // 18: Repeat a code length of 0 for 11 - 138 times
+        // (7 bits of length)
+    } else {
+        return -1;
+    }
+    if (cl_val > max_bits || count + index > num_lengths) {
+        return -1;
+    }
+    while (count--) {
+        lengths[index++] = cl_val;
+    }
+    return index;
+}
+
+bool build_dynamic_tables(const uint8_t* lengths, int hlit, int hdist, decode_table& lit_len, decode_table& dist)
+{
+    return lengths[end_of_block] &&
+        lit_len.build(lengths, hlit, decode_table::alphabet::lit_len, 9) &&
+        dist.build(lengths + hlit, hdist, decode_table::alphabet::dist, 6);
+}
+
+int decode_base(const decode_table::entry& e, bit_stream& bs)
+{
+    const int n    = e.code_len() + e.extra_bits();
+    const auto bits = bs.peek_bits(n);
+    bs.consume_bits(n);
+    return e.value() + static_cast<int>(bits >> e.code_len());
+}
+
+// Decode without checking for the end of the input or output (or making steps resumable) while there is room for
+// a complete literal/length + distance sequence in both. Returns true at the end of the block.
+bool block_decoder::decode_codes_fast(bit_stream& bs, output_buffer& output)
+{
+    // Input bytes needed to refill without reading past the end
+    constexpr int min_input = 8;
+    static_assert(max_sequence_bits <= 8 * min_input, "");
+
+    if (output.chunk_avail() < max_match_length) {
+        return false;
+    }
+
+    const auto& lit_len_table = *cur_lit_len_table_;
+    const auto& dist_table    = *cur_dist_table_;
+
+    // Work on local copies, which (unlike output) can't alias the output bytes and stay in registers
+    auto in = bs;
+    const uint8_t* const out_begin = output.data();
+    uint8_t*             out       = output.end();
+    uint8_t* const       out_limit = out + output.chunk_avail() - max_match_length;
+    bool                 end       = false;
+
+    // Each iteration starts with max_sequence_bits in the bit buffer and e looked up from them. Refilling only adds
+    // bits above those, so e stays valid across the refill at the end of the iteration.
+    in.ensure_bits(max_sequence_bits);
+    auto e = lit_len_table.lookup(in.peek_bits(max_bits));
+    while (out <= out_limit && in.remaining_bytes() >= min_input) {
+        if (e.is_literal()) {
+            // Runs of literals: after one literal code enough bits are left to decode two more without refilling
+            static_assert(max_sequence_bits >= 3 * max_bits, "");
+            DEFLATE_STAT(++thread_inflate_stats().fast_path_symbols; ++thread_inflate_stats().literals);
+            in.consume_bits(e.code_len());
+            *out++ = static_cast<uint8_t>(e.value());
+            e = lit_len_table.lookup(in.peek_bits(max_bits));
+            if (e.is_literal()) {
+                DEFLATE_STAT(++thread_inflate_stats().fast_path_symbols; ++thread_inflate_stats().literals);
+                in.consume_bits(e.code_len());
+                *out++ = static_cast<uint8_t>(e.value());
+                e = lit_len_table.lookup(in.peek_bits(max_bits));
+            }
+            in.ensure_bits(max_sequence_bits);
+            continue;
+        }
+        DEFLATE_STAT(++thread_inflate_stats().fast_path_symbols);
+        if (!e.is_base()) {
+            in.consume_bits(e.code_len());
+            if (e.is_end_of_block()) {
+                end = true;
+                break;
+            }
+            throw_deflate_error(error_code::invalid_symbol);
+        }
+        const int len = decode_base(e, in);
+        const auto de = dist_table.lookup(in.peek_bits(max_bits));
+        if (!de.is_base()) {
+            throw_deflate_error(error_code::invalid_symbol);
+        }
+        const int dist = decode_base(de, in);
+        if (dist > out - out_begin) {
+            throw_deflate_error(error_code::invalid_distance);
+        }
+        DEFLATE_STAT(count_match(len, dist));
+        copy_match(out, dist, len);
+        out += len;
+        in.ensure_bits(max_sequence_bits);
+        e = lit_len_table.lookup(in.peek_bits(max_bits));
+    }
+
+    output.commit(out);
+    bs = in;
+    return end;
+}
+
+// Returns status::done at the end of the block
+block_decoder::status block_decoder::decode_codes(bit_stream& bs, output_buffer& output)
+{
+    if (decode_codes_fast(bs, output)) {
+        return status::done;
+    }
+
+    // Near the end of the input or output
+    const auto& lit_len_table = *cur_lit_len_table_;
+    const auto& dist_table    = *cur_dist_table_;
+
+    for (;;) {
+        // One refill covers the whole literal or match
+        bs.ensure_bits(max_sequence_bits);
+        const auto saved = bs;
+
+        // decode literal/length value from input stream
+        const auto e = lit_len_table.lookup(bs.peek_bits(max_bits));
+        if (e.is_literal()) {
+            // if value < 256
+            //    copy value (literal byte) to output stream
+            bs.consume_bits(e.code_len());
+            if (bs.overrun()) {
+                return need_more_input(bs, saved);
+            }
+            if (!output.avail()) {
+                bs = saved;
+                return status::need_output;
+            }
+            DEFLATE_STAT(++thread_inflate_stats().slow_path_symbols; ++thread_inflate_stats().literals);
+            output.put(static_cast<uint8_t>(e.value()));
+        } else if (e.is_end_of_block()) {
+            // if value = end of block (256)
+            //    break from loop
+            bs.consume_bits(e.code_len());
+            if (bs.overrun()) {
+                return need_more_input(bs, saved);
+            }
+            DEFLATE_STAT(++thread_inflate_stats().slow_path_symbols);
+            return status::done;
+        } else {
+            // otherwise (value = 257..285)
+            //    decode distance from input stream
+            //
+            //    move backwards distance bytes in the output
+            //    stream, and copy length bytes from this
+            //    position to the output stream.
+            if (!e.is_base()) {
+                bs.consume_bits(e.code_len());
+                if (bs.overrun()) {
+                    return need_more_input(bs, saved);
+                }
+                throw_deflate_error(error_code::invalid_symbol);
+            }
+            const int len = decode_base(e, bs);
+            assert(len >= 3 && len <= max_match_length);
+
+            const auto de = dist_table.lookup(bs.peek_bits(max_bits));
+            if (!de.is_base()) {
+                bs.consume_bits(de.code_len());
+                if (bs.overrun()) {
+                    return need_more_input(bs, saved);
+                }
+                throw_deflate_error(error_code::invalid_symbol);
+            }
+            const int dist = decode_base(de, bs);
+            if (bs.overrun()) {
+                return need_more_input(bs, saved);
+            }
+
+            if (dist > output.used()) {
+                throw_deflate_error(error_code::invalid_distance);
+            }
+            if (len > output.avail()) {
+                bs = saved;
+                return status::need_output;
+            }
+            DEFLATE_STAT(++thread_inflate_stats().slow_path_symbols; count_match(len, dist));
+            output.copy_match(dist, len);
+        }
+    }
+}
+
+} // namespace deflate
@@ -0,0 +1,106 @@
+#ifndef DEFLATE_BLOCK_DECODER_H
+#define DEFLATE_BLOCK_DECODER_H
+
+#include "bit_stream.h"
+#include "output_buffer.h"
+#include "decode_table.h"
+
+namespace deflate {
+
+// Longest literal/length code + extra bits + distance code + extra bits
+constexpr int max_sequence_bits = max_bits + 5 + max_bits + 13;
+static_assert(max_sequence_bits <= bit_stream::max_ensure_bits, "");
+
+// Consume the code and extra bits of e, returning the length or distance
+int decode_base(const decode_table::entry& e, bit_stream& bs);
+
+// Decode a code length symbol of a dynamic block header (and the repeat count following it) using cl_table to
+// lengths[index...], returning the index following the stored lengths. Nothing is stored (and index is returned) if bs
+// overruns. Returns -1 if the symbol is invalid or repeats past num_lengths.
+int decode_code_length(const decode_table& cl_table, bit_stream& bs, uint8_t* lengths, int index, int num_lengths);
+
+// Build the tables of a dynamic block from its hlit literal/length and hdist distance code lengths. Returns false if
+// they don't describe valid codes (or there's no end of block code).
+bool build_dynamic_tables(const uint8_t* lengths, int hlit, int hdist, decode_table& lit_len, decode_table& dist);
+
+// Resumable decoder for a sequence of deflate blocks.
+//
+// decode() makes as much progress as the input in the bit_stream and the space in the output_buffer allow. Each step
+// (a block header field, a code length or a literal/length + distance pair) is either completed or not started, so
+// when the input is exhausted the decoder can continue with a new bit_stream at any bit boundary.
+class block_decoder {
+public:
+    enum class status {
+        need_input,  // All input consumed (remaining bits are left in the bit buffer), continue with more input
+        need_output, // The next literal or match doesn't fit in the output buffer (max_match_length bytes always do)
+        done,        // Final block decoded
+    };
+
+    explicit block_decoder() {
+    }
+
+    // Start over with a new stream. Cheaper than assigning a new decoder as the tables are left alone.
+    void reset() {
+        state_             = state::block_header;
+        last_block_        = false;
+        stored_remaining_  = 0;
+        cur_lit_len_table_ = nullptr;
+        cur_dist_table_    = nullptr;
+    }
+
+    // Throws std::runtime_error on invalid input
+    status decode(bit_stream& bs, output_buffer& output) {
+        return decode(bs, output, false);
+    }
+
+    // Like decode(), but also returns status::done at the end of each block (then at_block_boundary() unless done())
+    status decode_block(bit_stream& bs, output_buffer& output) {
+        return decode(bs, output, true);
+    }
+
+    bool done() const {
+        return state_ == state::done;
+    }
+
+    // Between blocks, the next block doesn't depend on the decoder state (only on the output history)
+    bool at_block_boundary() const {
+        return state_ == state::block_header;
+    }
+
+private:
+    enum class state { block_header, stored_header, stored_data, dynamic_header, code_length_codes, code_lengths, codes, done };
+
+    static constexpr int max_code_length_codes = 19;
+    static constexpr int max_lit_len_codes     = 288;
+    static constexpr int max_dist_codes        = 32;
+
+    state               state_ = state::block_header;
+    bool                last_block_ = false;
+
+    // Stored block bytes left to copy
+    int                 stored_remaining_ = 0;
+
+    // Dynamic block header
+    int                 hlit_  = 0;
+    int                 hdist_ = 0;
+    int                 hclen_ = 0;
+    int                 index_ = 0;
+    uint8_t             code_lengths_[max_lit_len_codes + max_dist_codes];
+    decode_table        cl_table_;
+
+    decode_table        lit_len_table_;
+    decode_table        dist_table_;
+    const decode_table* cur_lit_len_table_ = nullptr;
+    const decode_table* cur_dist_table_    = nullptr;
+
+    status decode(bit_stream& bs, output_buffer& output, bool stop_at_block_end);
+    status decode_stored_header(bit_stream& bs);
+    status decode_stored_data(bit_stream& bs, output_buffer& output);
+    status decode_dynamic_header(bit_stream& bs);
+    status decode_codes(bit_stream& bs, output_buffer& output);
+    bool decode_codes_fast(bit_stream& bs, output_buffer& output);
+};
+
+} // namespace deflate
+
+#endif
@@ -0,0 +1,151 @@
+#include "code_lengths.h"
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+namespace deflate {
+
+// Package-merge for the n weights (sorted ascending): the cheapest 2n-2 items of the list formed by pairing up the
+// items of the previous level and merging the packages with the leaves, max_len lists deep. Each selected item adds
+// one bit to the leaves in it.
+void package_merge(const uint64_t* weights, int n, int max_len, uint8_t* depths)
+{
+    assert(n >= 2 && n <= (1 << max_len));
+    constexpr int16_t package = -1;
+    std::vector<uint64_t> item_weights(static_cast<size_t>(max_len) * 2 * n);
+    std::vector<int16_t>  item_kinds(item_weights.size()); // Leaf index or package
+    std::vector<int>      level_size(max_len);
+
+    for (int i = 0; i < n; ++i) {
+        item_weights[i] = weights[i];
+        item_kinds[i]   = static_cast<int16_t>(i);
+    }
+    level_size[0] = n;
+    for (int level = 1; level < max_len; ++level) {
+        const auto prev_w = &item_weights[(level - 1) * 2 * n];
+        const auto w      = &item_weights[level * 2 * n];
+        const auto kinds  = &item_kinds[level * 2 * n];
+        const int  num_packages = level_size[level - 1] / 2;
+        int leaf = 0, pkg = 0, size = 0;
+        while (leaf < n || pkg < num_packages) {
+            const auto pkg_weight = pkg < num_packages ? prev_w[2 * pkg] + prev_w[2 * pkg + 1] : 0;
+            if (pkg == num_packages || (leaf < n && weights[leaf] <= pkg_weight)) {
+                w[size]     = weights[leaf];
+                kinds[size] = static_cast<int16_t>(leaf++);
+            } else {
+                w[size]     = pkg_weight;
+                kinds[size] = package;
+                ++pkg;
+            }
+            ++size;
+        }
+        level_size[level] = size;
+    }
+
+    std::fill(depths, depths + n, static_cast<uint8_t>(0));
+    int selected = 2 * n - 2;
+    for (int level = max_len - 1; level >= 0; --level) {
+        assert(selected <= level_size[level]);
+        const auto kinds = &item_kinds[level * 2 * n];
+        int packages = 0;
+        for (int i = 0; i < selected; ++i) {
+            if (kinds[i] == package) {
+                ++packages;
+            } else {
+                ++depths[kinds[i]];
+            }
+        }
+        selected = 2 * packages;
+    }
+}
+
+void make_code_lengths(const uint32_t* freqs, int num_symbols, int max_len, uint8_t* lengths)
+{
+    assert(num_symbols >= 2 && num_symbols <= max_code_length_symbols && (1 << max_len) >= num_symbols);
+    int symbols[max_code_length_symbols];
+    int n = 0;
+    for (int i = 0; i < num_symbols; ++i) {
+        if (freqs[i]) {
+            symbols[n++] = i;
+        }
+    }
+    for (int i = 0; n < 2; ++i) {
+        if (!freqs[i]) {
+            symbols[n++] = i;
+        }
+    }
+    std::sort(symbols, symbols + n, [freqs](int a, int b) { return freqs[a] < freqs[b] || (freqs[a] == freqs[b] && a < b); });
+
+    // Huffman's algorithm with two queues: the sorted leaves and the internal nodes, which are made in order of
+    // increasing weight
+    uint64_t weight[2 * max_code_length_symbols];
+    int      parent[2 * max_code_length_symbols];
+    for (int i = 0; i < n; ++i) {
+        weight[i] = freqs[symbols[i]];
+    }
+    int leaf = 0, node = n;
+    auto take_smallest = [&](int next) {
+        const int i = leaf < n && (node == next || weight[leaf] <= weight[node]) ? leaf++ : node++;
+        parent[i] = next;
+        return weight[i];
+    };
+    for (int next = n; next < 2 * n - 1; ++next) {
+        const auto w = take_smallest(next);
+        weight[next] = w + take_smallest(next);
+    }
+    uint8_t depth[2 * max_code_length_symbols];
+    depth[2 * n - 2] = 0;
+    int longest = 0;
+    for (int i = 2 * n - 3; i >= 0; --i) {
+        depth[i] = static_cast<uint8_t>(depth[parent[i]] + 1);
+        longest  = std::max(longest, static_cast<int>(depth[i]));
+    }
+    if (longest > max_len) {
+        for (int i = 0; i < n; ++i) {
+            weight[i] = freqs[symbols[i]];
+        }
+        package_merge(weight, n, max_len, depth);
+    }
+
+    std::fill(lengths, lengths + num_symbols, static_cast<uint8_t>(0));
+    for (int i = 0; i < n; ++i) {
+        lengths[symbols[i]] = depth[i];
+    }
+}
+
+int encode_code_lengths(const uint8_t* lengths, int num_lengths, code_length_symbol* out)
+{
+    int count = 0;
+    auto put = [&](int symbol, int extra) {
+        out[count++] = code_length_symbol{static_cast<uint8_t>(symbol), static_cast<uint8_t>(extra)};
+    };
+    for (int i = 0; i < num_lengths;) {
+        const auto len = lengths[i];
+        int run = 1;
+        while (i + run < num_lengths && lengths[i + run] == len) {
+            ++run;
+        }
+        i += run;
+        if (len == 0) {
+            for (; run >= 11; run -= std::min(run, 138)) {
+                put(18, std::min(run, 138) - 11);
+            }
+            if (run >= 3) {
+                put(17, run - 3);
+                run = 0;
+            }
+        } else {
+            put(len, 0);
+            for (--run; run >= 3; run -= std::min(run, 6)) {
+                put(16, std::min(run, 6) - 3);
+            }
+        }
+        for (; run > 0; --run) {
+            put(len, 0);
+        }
+    }
+    return count;
+}
+
+} // namespace deflate
@@ -0,0 +1,30 @@
+#ifndef DEFLATE_CODE_LENGTHS_H
+#define DEFLATE_CODE_LENGTHS_H
+
+#include <stdint.h>
+
+namespace deflate {
+
+constexpr int max_code_length_symbols = 288;
+
+// Optimal code lengths of at most max_len bits for the symbol frequencies: Huffman's algorithm, or package-merge when
+// that gives a longer code. Symbols with zero frequency get length 0, except that at least two symbols always get a
+// code so it's complete.
+void make_code_lengths(const uint32_t* freqs, int num_symbols, int max_len, uint8_t* lengths);
+
+// Symbol of the code length alphabet (rfc1951 3.2.7), 16-18 repeat the previous length or zero extra + 3, 3 or 11
+// times
+struct code_length_symbol {
+    uint8_t symbol;
+    uint8_t extra;
+};
+
+constexpr int code_length_extra_bits[19] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 7 };
+
+// Run-length encode the code lengths to out (which needs room for num_lengths symbols), returns the number of
+// symbols
+int encode_code_lengths(const uint8_t* lengths, int num_lengths, code_length_symbol* out);
+
+} // namespace deflate
+
+#endif
@@ -1,6 +1,24 @@
 #include "crc.h"
 #include <array>
 #include <utility>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define HAS_CRC32_PCLMUL
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CRC32_PCLMUL_TARGET
+#else
+#define CRC32_PCLMUL_TARGET __attribute__((target("pclmul,sse4.1")))
+#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define HAS_CRC32_ARMV8
+#include <arm_acle.h>
+#endif
 
 namespace deflate {
 
@@ -27,11 +45,40 @@ constexpr std::array<uint32_t, 256> make_crc32_table(std::index_sequence<is...>)
 constexpr std::array<uint32_t, 256> crc32_table = make_crc32_table(std::make_index_sequence<256>());
 static_assert(crc32_table[0] == 0, "");
 static_assert(crc32_table[255] == 0x2d02ef8d, "");
+
+// Slice-by-16: crc32_slice_tables[k*256+n] is the CRC of byte n followed by k zero bytes, so 16 bytes can be
+// processed with independent lookups
+constexpr int crc32_slices = 16;
+
+constexpr uint32_t crc32_slice_entry(int k, uint32_t n)
+{
+    auto c = crc32_one_byte(n);
+    while (k--) {
+        c = (c >> 8) ^ crc32_one_byte(c & 0xff);
+    }
+    return c;
+}
+
+template<size_t... is>
+constexpr std::array<uint32_t, 256 * crc32_slices> make_crc32_slice_tables(std::index_sequence<is...>)
+{
+    return { crc32_slice_entry(static_cast<int>(is / 256), is % 256)... };
+}
+
+constexpr std::array<uint32_t, 256 * crc32_slices> crc32_slice_tables = make_crc32_slice_tables(std::make_index_sequence<256 * crc32_slices>());
+static_assert(crc32_slice_tables[255] == crc32_table[255], "");
+static_assert(crc32_slice_tables[256 + 1] == ((crc32_table[1] >> 8) ^ crc32_table[crc32_table[1] & 0xff]), "");
+
+inline uint32_t load_le32(const uint8_t* p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
 #endif
 
-uint32_t update_crc32(uint32_t crc, const uint8_t* beg, const uint8_t* end)
+// The crc32_* functions work on the inverted CRC
+
+uint32_t crc32_bytewise(uint32_t crc, const uint8_t* beg, const uint8_t* end)
 {
-    crc ^= ~0U;
     for (auto p = beg; p != end; ++p) {
 #ifdef USE_CRC32_TABLE
         crc = crc32_table[(crc ^ *p) & 0xff] ^ (crc >> 8);
@@ -39,8 +86,190 @@ uint32_t update_crc32(uint32_t crc, const uint8_t* beg, const uint8_t* end)
         crc = crc32_one_byte(crc ^ *p);
 #endif
     }
-    crc ^= ~0U;
     return crc;
 }
 
+uint32_t crc32_sliced(uint32_t crc, const uint8_t* beg, const uint8_t* end)
+{
+    auto p = beg;
+#ifdef USE_CRC32_TABLE
+    auto t = [](int k, uint32_t v) { return crc32_slice_tables[k * 256 + (v & 0xff)]; };
+    for (; end - p >= crc32_slices; p += crc32_slices) {
+        const auto a = load_le32(p) ^ crc;
+        const auto b = load_le32(p + 4);
+        const auto c = load_le32(p + 8);
+        const auto d = load_le32(p + 12);
+        crc = t(15, a) ^ t(14, a >> 8) ^ t(13, a >> 16) ^ t(12, a >> 24) ^
+              t(11, b) ^ t(10, b >> 8) ^ t( 9, b >> 16) ^ t( 8, b >> 24) ^
+              t( 7, c) ^ t( 6, c >> 8) ^ t( 5, c >> 16) ^ t( 4, c >> 24) ^
+              t( 3, d) ^ t( 2, d >> 8) ^ t( 1, d >> 16) ^ t( 0, d >> 24);
+    }
+#endif
+    return crc32_bytewise(crc, p, end);
+}
+
+#ifdef HAS_CRC32_PCLMUL
+// Folding with carry-less multiplication as described in "Fast CRC Computation for Generic Polynomials Using
+// PCLMULQDQ Instruction" (Intel, 2009), using the constants for the bit-reflected gzip polynomial.
+// x * k (low halves) ^ x * k (high halves) ^ y
+CRC32_PCLMUL_TARGET inline __m128i crc32_fold(__m128i x, __m128i k, __m128i y)
+{
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), y);
+}
+
+// len must be a multiple of 16 and at least 64.
+CRC32_PCLMUL_TARGET uint32_t crc32_pclmul_blocks(uint32_t crc, const uint8_t* p, size_t len)
+{
+    alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+    alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+    alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+    alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+    auto load = [](const uint8_t* q) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(q)); };
+
+    auto x1 = _mm_xor_si128(load(p), _mm_cvtsi32_si128(static_cast<int>(crc)));
+    auto x2 = load(p + 16);
+    auto x3 = load(p + 32);
+    auto x4 = load(p + 48);
+    p   += 64;
+    len -= 64;
+
+    // Fold 4 blocks in parallel
+    auto k = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+    for (; len >= 64; p += 64, len -= 64) {
+        x1 = crc32_fold(x1, k, load(p));
+        x2 = crc32_fold(x2, k, load(p + 16));
+        x3 = crc32_fold(x3, k, load(p + 32));
+        x4 = crc32_fold(x4, k, load(p + 48));
+    }
+
+    // Fold into 128 bits
+    k  = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+    x1 = crc32_fold(x1, k, x2);
+    x1 = crc32_fold(x1, k, x3);
+    x1 = crc32_fold(x1, k, x4);
+    for (; len >= 16; p += 16, len -= 16) {
+        x1 = crc32_fold(x1, k, load(p));
+    }
+
+    // Fold 128 bits to 64 bits
+    const auto mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    k  = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x00), x2);
+
+    // Barrett reduction to 32 bits
+    k  = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x10);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), k, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+uint32_t crc32_pclmul(uint32_t crc, const uint8_t* beg, const uint8_t* end)
+{
+    const auto len = static_cast<size_t>(end - beg);
+    if (len < 64) {
+        return crc32_sliced(crc, beg, end);
+    }
+    const auto blocks_len = len & ~static_cast<size_t>(15);
+    crc = crc32_pclmul_blocks(crc, beg, blocks_len);
+    return crc32_sliced(crc, beg + blocks_len, end);
+}
+
+bool has_pclmul()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 1)) && (info[2] & (1 << 19)); // PCLMULQDQ and SSE4.1
+#else
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#endif
+}
+#endif
+
+#ifdef HAS_CRC32_ARMV8
+uint32_t crc32_armv8(uint32_t crc, const uint8_t* beg, const uint8_t* end)
+{
+    auto p = beg;
+    for (; end - p >= 8; p += 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        crc = __crc32d(crc, v);
+    }
+    for (; p != end; ++p) {
+        crc = __crc32b(crc, *p);
+    }
+    return crc;
+}
+#endif
+
+using crc32_function = uint32_t (*)(uint32_t crc, const uint8_t* beg, const uint8_t* end);
+
+crc32_function select_crc32_function()
+{
+#ifdef HAS_CRC32_PCLMUL
+    if (has_pclmul()) {
+        return &crc32_pclmul;
+    }
+#endif
+#ifdef HAS_CRC32_ARMV8
+    return &crc32_armv8;
+#else
+    return &crc32_sliced;
+#endif
+}
+
+// Chosen once at startup, so there's no check of a static initialization guard on every call
+const crc32_function crc32_impl = select_crc32_function();
+
+uint32_t update_crc32(uint32_t crc, const uint8_t* beg, const uint8_t* end)
+{
+    return ~crc32_impl(~crc, beg, end);
+}
+
+// Product of two polynomials modulo the CRC-32 polynomial (bit reflected, x^0 is the most significant bit)
+constexpr uint32_t crc32_multiply(uint32_t a, uint32_t b)
+{
+    uint32_t p = 0;
+    for (uint32_t m = 1U << 31; m; m >>= 1) {
+        if (a & m) {
+            p ^= b;
+        }
+        b = crc32_one_bit(b);
+    }
+    return p;
+}
+
+// x^(2^k) modulo the CRC-32 polynomial, for up to 2^64 bytes (2^3 bits each)
+constexpr int crc32_x2k_entries = 3 + 64;
+
+constexpr std::array<uint32_t, crc32_x2k_entries> make_crc32_x2k_table()
+{
+    std::array<uint32_t, crc32_x2k_entries> t{};
+    uint32_t p = 1U << 30; // x^1
+    for (size_t k = 0; k < t.size(); ++k) {
+        t[k] = p;
+        p = crc32_multiply(p, p);
+    }
+    return t;
+}
+
+constexpr std::array<uint32_t, crc32_x2k_entries> crc32_x2k_table = make_crc32_x2k_table();
+
+uint32_t combine_crc32(uint32_t crc1, uint32_t crc2, uint64_t len2)
+{
+    // Appending len2 bytes multiplies crc1 by x^(8*len2), crc2 accounts for the bytes themselves
+    uint32_t x = 1U << 31; // x^0
+    for (int k = 3; len2; len2 >>= 1, ++k) {
+        if (len2 & 1) {
+            x = crc32_multiply(crc32_x2k_table[k], x);
+        }
+    }
+    return crc32_multiply(x, crc1) ^ crc2;
+}
+
 } // namespace deflate
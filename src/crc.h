@@ -7,6 +7,9 @@ namespace deflate {
 
 uint32_t update_crc32(uint32_t crc, const uint8_t* beg, const uint8_t* end);
 
+// CRC-32 of the concatenation of two buffers given the CRC-32 of each and the length of the second
+uint32_t combine_crc32(uint32_t crc1, uint32_t crc2, uint64_t len2);
+
 } // namespace deflate
 
 #endif
@@ -0,0 +1,27 @@
+#include "decode_table.h"
+
+namespace deflate {
+
+constexpr decode_table make_fixed_decode_table(decode_table::alphabet a)
+{
+    uint8_t lengths[decode_table::max_symbols] = {};
+    decode_table table;
+    if (a == decode_table::alphabet::lit_len) {
+        for (int i = 0; i < 288; ++i) {
+            lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+        }
+        table.build(lengths, 288, a, 9);
+    } else {
+        // Distance codes 0-31 are represented by (fixed-length) 5-bit codes
+        for (int i = 0; i < 32; ++i) {
+            lengths[i] = 5;
+        }
+        table.build(lengths, 32, a, 5);
+    }
+    return table;
+}
+
+constexpr decode_table fixed_lit_len_decode_table = make_fixed_decode_table(decode_table::alphabet::lit_len);
+constexpr decode_table fixed_dist_decode_table    = make_fixed_decode_table(decode_table::alphabet::dist);
+
+} // namespace deflate
@@ -0,0 +1,208 @@
+#ifndef DEFLATE_DECODE_TABLE_H
+#define DEFLATE_DECODE_TABLE_H
+
+#include "huffman_code.h"
+#include "deflate_alphabet.h"
+#include "inflate_stats.h"
+#include <cassert>
+#include <algorithm>
+
+namespace deflate {
+
+// Table for decoding the literal/length or distance alphabet where each entry holds what the symbol means for the
+// decoder: a literal byte, the end of the block or the base value and number of extra bits of a length or distance.
+// Codes longer than table_bits() are resolved through a subtable.
+class decode_table {
+public:
+    // For the code length alphabet entries are literals with the symbol as value
+    enum class alphabet { lit_len, dist, code_length };
+
+    static constexpr int max_symbols       = 288;
+    static constexpr int max_table_bits    = 9;
+    // Room for the subtables of any complete code with up to max_symbols symbols and at least 6 table bits
+    static constexpr int max_table_entries = (1<<max_table_bits) + 1024;
+
+    class entry {
+    public:
+        enum : uint32_t {
+            literal_flag      = 1 << 8,
+            end_of_block_flag = 1 << 9,
+            subtable_flag     = 1 << 10,
+            invalid_flag      = 1 << 11,
+        };
+
+        constexpr explicit entry() : repr_(0) {
+        }
+        constexpr explicit entry(uint32_t flags, int code_len, int extra_bits, int value) : repr_((static_cast<uint32_t>(value) << 16) | flags | static_cast<uint32_t>(extra_bits << 4) | static_cast<uint32_t>(code_len)) {
+            assert(code_len > 0 && code_len <= max_bits);
+            assert(extra_bits >= 0 && extra_bits < 16);
+            assert(value >= 0 && value < 65536);
+        }
+
+        // Number of bits of the huffman code (table_bits() for subtable references)
+        constexpr int code_len() const { return repr_ & 0xf; }
+        // Number of extra bits following the code (for subtable references the number of bits indexing the subtable)
+        constexpr int extra_bits() const { return (repr_ >> 4) & 0xf; }
+        // Literal byte, base length/distance or subtable start
+        constexpr int value() const { return static_cast<int>(repr_ >> 16); }
+
+        constexpr bool is_literal() const { return (repr_ & literal_flag) != 0; }
+        constexpr bool is_end_of_block() const { return (repr_ & end_of_block_flag) != 0; }
+        constexpr bool is_subtable() const { return (repr_ & subtable_flag) != 0; }
+        constexpr bool is_invalid() const { return (repr_ & invalid_flag) != 0; }
+        // Length (lit_len alphabet) or distance
+        constexpr bool is_base() const { return (repr_ & (literal_flag | end_of_block_flag | subtable_flag | invalid_flag)) == 0; }
+
+        constexpr bool operator==(const entry& rhs) const { return repr_ == rhs.repr_; }
+
+    private:
+        uint32_t repr_;
+    };
+
+    constexpr explicit decode_table() {
+    }
+
+    // The code lengths must describe a valid code
+    constexpr explicit decode_table(const uint8_t* code_lengths, int num_symbols, alphabet a, int table_bits) {
+        const bool valid = build(code_lengths, num_symbols, a, table_bits);
+        assert(valid); (void)valid;
+    }
+
+    // Build the table for the canonical code with the given code lengths (0 for unused symbols) without allocating.
+    // Returns false if the code is over-subscribed or incomplete, except for codes with a single 1 bit code or no
+    // codes at all (as used for distances) where the missing entries are marked invalid. Usable in constant
+    // expressions, which is how the fixed tables are built.
+    constexpr bool build(const uint8_t* code_lengths, int num_symbols, alphabet a, int table_bits);
+
+    constexpr int table_bits() const {
+        return table_bits_;
+    }
+
+    // Resolve the code at the start of bits (which must contain at least max_bits bits)
+    entry lookup(uint32_t bits) const {
+        auto e = table_[bits & ((1 << table_bits_) - 1)];
+        if (e.is_subtable()) {
+            DEFLATE_STAT(++thread_inflate_stats().subtable_lookups);
+            e = table_[e.value() + ((bits >> table_bits_) & ((1 << e.extra_bits()) - 1))];
+        }
+        return e;
+    }
+
+private:
+    int   table_bits_ = 0;
+    entry table_[max_table_entries];
+
+    static constexpr entry symbol_entry(alphabet a, int symbol, int code_len);
+};
+
+constexpr decode_table::entry decode_table::symbol_entry(alphabet a, int symbol, int code_len)
+{
+    if (a == alphabet::lit_len) {
+        if (symbol <= lit_max) {
+            return entry{entry::literal_flag, code_len, 0, symbol};
+        } else if (symbol == end_of_block) {
+            return entry{entry::end_of_block_flag, code_len, 0, 0};
+        } else if (symbol <= len_max) {
+            return entry{0, code_len, length_extra_bits[symbol - len_min], length_base[symbol - len_min]};
+        }
+    } else if (a == alphabet::code_length) {
+        return entry{entry::literal_flag, code_len, 0, symbol};
+    } else if (symbol < num_distance_codes) {
+        return entry{0, code_len, distance_extra_bits[symbol], distance_base[symbol]};
+    }
+    return entry{entry::invalid_flag, code_len, 0, 0};
+}
+
+constexpr bool decode_table::build(const uint8_t* code_lengths, int num_symbols, alphabet a, int table_bits)
+{
+    assert(num_symbols > 0 && num_symbols <= max_symbols);
+    assert(table_bits > 0 && table_bits <= max_table_bits);
+
+    int count[max_bits + 1] = {};
+    int max_len = 0;
+    for (int i = 0; i < num_symbols; ++i) {
+        assert(code_lengths[i] <= max_bits);
+        ++count[code_lengths[i]];
+        max_len = std::max<int>(max_len, code_lengths[i]);
+    }
+    count[0] = 0;
+
+    // First code of each length (rfc1951 3.2.2), checking that no more codes are used than there's room for
+    int next_code[max_bits + 1] = {};
+    int code = 0;
+    int left = 1;
+    for (int len = 1; len <= max_bits; ++len) {
+        code = (code + count[len - 1]) << 1;
+        next_code[len] = code;
+        left = 2 * left - count[len];
+        if (left < 0) {
+            return false;
+        }
+    }
+    if (left && max_len > 1) {
+        return false;
+    }
+
+    table_bits_ = table_bits;
+    const int table_size = 1 << table_bits;
+    if (left) {
+        for (int i = 0; i < table_size; ++i) {
+            table_[i] = entry{entry::invalid_flag, 1, 0, 0};
+        }
+    }
+
+    if (max_len > table_bits) {
+        // Size the subtable of each table_bits prefix for its longest code
+        uint8_t sub_bits[1 << max_table_bits] = {};
+        int sub_code[max_bits + 1] = {};
+        for (int len = 1; len <= max_bits; ++len) {
+            sub_code[len] = next_code[len];
+        }
+        for (int i = 0; i < num_symbols; ++i) {
+            const int len = code_lengths[i];
+            if (len > table_bits) {
+                const int prefix = reversed_code(sub_code[len]++ >> (len - table_bits), table_bits);
+                sub_bits[prefix] = std::max(sub_bits[prefix], static_cast<uint8_t>(len - table_bits));
+            }
+        }
+        int next_subtable = table_size;
+        for (int i = 0; i < table_size; ++i) {
+            if (sub_bits[i]) {
+                if (next_subtable + (1 << sub_bits[i]) > max_table_entries) {
+                    return false;
+                }
+                table_[i] = entry{entry::subtable_flag, table_bits, sub_bits[i], next_subtable};
+                next_subtable += 1 << sub_bits[i];
+            }
+        }
+    }
+
+    for (int i = 0; i < num_symbols; ++i) {
+        const int len = code_lengths[i];
+        if (!len) {
+            continue;
+        }
+        const auto e = symbol_entry(a, i, len);
+        const int  r = reversed_code(next_code[len]++, len);
+        if (len <= table_bits) {
+            for (int j = r; j < table_size; j += 1 << len) {
+                table_[j] = e;
+            }
+        } else {
+            const auto sub = table_[r & (table_size - 1)];
+            assert(sub.is_subtable());
+            for (int j = r >> table_bits; j < 1 << sub.extra_bits(); j += 1 << (len - table_bits)) {
+                table_[sub.value() + j] = e;
+            }
+        }
+    }
+    return true;
+}
+
+// The tables for the fixed Huffman codes (rfc1951 3.2.6), generated at compile time
+extern const decode_table fixed_lit_len_decode_table;
+extern const decode_table fixed_dist_decode_table;
+
+} // namespace deflate
+
+#endif
@@ -1,272 +1,209 @@
 #include "deflate.h"
-#include "huffman_tree.h"
-#include "huffman_table.h"
+#include "deflate_error.h"
+#include "block_decoder.h"
+#include "output_buffer.h"
+#include "parallel_inflate.h"
+#include "crc.h"
+#include "adler32.h"
 
-#include <stdexcept>
-#include <string.h>
-#include <stdlib.h>
-#include <memory>
+#include <stddef.h>
+#include <cassert>
+#include <algorithm>
 
 namespace deflate {
 
-enum class block_type { uncompressed, fixed_huffman, dynamic_huffman, reserved };
-
-constexpr int max_match_length = 258;
-
-int decode(const huffman_tree& t, bit_stream& bs)
+std::vector<uint8_t> deflate(bit_stream& bs)
 {
-    int value = huffman_tree::max_symbols;
-    if (bs.potentially_available_bits() >= t.table_bits()) {
-        bs.ensure_bits(t.table_bits());
-        auto te = t.next_from_bits(bs.peek_bits(t.table_bits()), t.table_bits());
-        bs.consume_bits(te.len());
-        value = te.index();
-    }
-    while (value >= huffman_tree::max_symbols) {
-        value = t.branch(value - huffman_tree::max_symbols, !!bs.get_bit());
-    }
-    return value;
-}
-
-class output_buffer {
-public:
-    void put(uint8_t c) {
-        assert(used() < capacity());
-        buffer_[used_++] = c;
-    }
-
-    void copy_match(int distance, int length) {
-        assert(distance <= used_);
-        assert(distance < 32768);
-        assert(length >= 3 && length <= max_match_length);
-        uint8_t* out = buffer_.get() + used_;
-        const uint8_t* in = out - distance;
-        used_ += length;
-        if (distance >= length) {
-            memcpy(out, in, length);
-        } else {
-            do {
-                *out++ = *in++;
-            } while (--length);
+    block_decoder decoder;
+    output_buffer output;
+    for (;;) {
+        switch (decoder.decode(bs, output)) {
+        case block_decoder::status::need_output:
+            output.enlarge();
+            break;
+        case block_decoder::status::need_input:
+            throw_deflate_error(error_code::truncated);
+        case block_decoder::status::done:
+            return output.finish();
         }
     }
+}
 
-    int used() const {
-        return used_;
-    }
-
-    int avail() const {
-        return capacity() - used();
-    }
-
-    int capacity() const {
-        return capacity_;
+// Decode a complete deflate stream from bs into output, which can't be enlarged
+void inflate_into(bit_stream& bs, output_buffer& output)
+{
+    block_decoder decoder;
+    switch (decoder.decode(bs, output)) {
+    case block_decoder::status::need_output:
+        throw_deflate_error(error_code::output_too_small);
+    case block_decoder::status::need_input:
+        throw_deflate_error(error_code::truncated);
+    case block_decoder::status::done:
+        break;
     }
+}
 
-    void enlarge() {
-        if (!capacity_) {
-            capacity_ = 32768;
-            buffer_.reset(static_cast<uint8_t*>(malloc(capacity_)));
-            if (!buffer_) throw std::bad_alloc{};
-            return;
-        }
-        const auto new_capacity = 2 * capacity_;
-        buf_ptr new_buffer(static_cast<uint8_t*>(realloc(buffer_.get(), new_capacity)));
-        if (!new_buffer) throw std::bad_alloc{};
-        buffer_.release(); // buffer is now dangling, release it
-        buffer_ = std::move(new_buffer);
-        capacity_ = new_capacity;
-    }
+size_t deflate(bit_stream& bs, uint8_t* out, uint8_t* out_end)
+{
+    output_buffer output{out, out_end};
+    inflate_into(bs, output);
+    return output.used();
+}
 
-    auto finish() {
-        return std::vector<uint8_t>{buffer_.get(), buffer_.get() + used_};
+uint32_t get_framing_bytes(const uint8_t* p, int bytes, bool big_endian)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < bytes; ++i) {
+        v = big_endian ? (v << 8) | p[i] : v | (static_cast<uint32_t>(p[i]) << (8 * i));
     }
+    return v;
+}
 
-private:
-    struct free_deleter {
-        void operator()(void* ptr) { free(ptr); }
-    };
-
-    using buf_ptr = std::unique_ptr<uint8_t[], free_deleter>;
-
-    buf_ptr buffer_;
-    int     used_ = 0;
-    int     capacity_ = 0;
-};
-
-bool deflate_inner(output_buffer& output, bit_stream& bs, const huffman_tree& lit_len_tree, const huffman_tree& dist_tree)
+uint32_t gzip_isize(const uint8_t* begin, const uint8_t* end)
 {
-    enum alphabet {
-        lit_min      = 0,
-        lit_max      = 255,
-        end_of_block = 256,
-        len_min      = 257,
-        len_max      = 285,
-    };
-    constexpr int extra_bits[1+len_max - len_min] = {
-        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
-    };
-    constexpr int lengths[1+len_max-len_min] = {
-        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
-    };
-    constexpr int distance_extra_bits[32] = {
-        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
-    };
-    constexpr int distance_length[32] = {
-        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
-    };
+    return end - begin >= 18 ? get_framing_bytes(end - 4, 4, false) : 0;
+}
 
-    for (;;) {
-        if (output.avail() < max_match_length) {
-            output.enlarge();
+size_t decompress(stream_format format, const uint8_t* begin, const uint8_t* end, uint8_t* out, uint8_t* out_end)
+{
+    auto truncated = [] { throw_deflate_error(error_code::truncated); };
+    const uint8_t* in  = begin;
+    uint8_t*       pos = out;
+    do {
+        if (format == stream_format::gzip) {
+            in = skip_gzip_header(in, end);
+            if (!in) truncated();
+        } else if (format == stream_format::zlib) {
+            if (end - in < 2) truncated();
+            const auto v = get_framing_bytes(in, 2, true);
+            if (((v >> 8) & 15) != 8 || (v >> 12) > 7 || v % 31) {
+                throw_deflate_error(error_code::invalid_zlib_header);
+            }
+            if (v & 0x20) {
+                throw_deflate_error(error_code::dictionary_required);
+            }
+            in += 2;
         }
 
-        // decode literal/length value from input stream
-        const int value = decode(lit_len_tree, bs);
-        if (value <= lit_max) {
-            // if value < 256
-            //    copy value (literal byte) to output stream
-            output.put(static_cast<uint8_t>(value));
-            //std::cout << "Lit " << litrep(value) << "\n";
-        } else if (value == end_of_block) {
-            // if value = end of block (256)
-            //    break from loop
-            return true;
-        } else {
-            // otherwise (value = 257..285)
-            //    decode distance from input stream
-            //
-            //    move backwards distance bytes in the output
-            //    stream, and copy length bytes from this
-            //    position to the output stream.
-            const auto eb = extra_bits[value - len_min];
-            int len = lengths[value - len_min];
-            if (eb) {
-                len += bs.get_bits(eb);
+        // Each gzip member gets a buffer of its own, so it can't reference earlier members
+        bit_stream    bs{in, end};
+        output_buffer output{pos, out_end};
+        inflate_into(bs, output);
+        bs.remove_padding();
+        bs.align_to_byte();
+        in = bs.position() - bs.available_bits() / 8;
+        const auto member = pos;
+        pos += output.used();
+
+        if (format == stream_format::gzip) {
+            if (end - in < 8) truncated();
+            if (get_framing_bytes(in, 4, false) != update_crc32(0, member, pos)) {
+                throw_deflate_error(error_code::crc32_mismatch);
             }
-            assert(len >= 3 && len <= max_match_length);
-
-            int dist = decode(dist_tree, bs);
-            const int dist_extra_bits = distance_extra_bits[dist];
-            int dist_bytes = distance_length[dist];
-            if (dist_extra_bits) {
-                dist_bytes += bs.get_bits(dist_extra_bits);
+            if (get_framing_bytes(in + 4, 4, false) != static_cast<uint32_t>(pos - member)) {
+                throw_deflate_error(error_code::isize_mismatch);
             }
-
-            if (dist_bytes > output.used()) {
-                return false;
+            in += 8;
+        } else if (format == stream_format::zlib) {
+            if (end - in < 4) truncated();
+            if (get_framing_bytes(in, 4, true) != update_adler32(1, member, pos)) {
+                throw_deflate_error(error_code::adler32_mismatch);
             }
-            output.copy_match(dist_bytes, len);
+            in += 4;
         }
-    }
+    } while (format == stream_format::gzip && in != end);
+    return pos - out;
 }
 
-bool read_dynamic_huffman_code_lengths(bit_stream& bs, std::vector<uint8_t>& cl2, int& number_of_lit_len_codes)
+// Decompress the stream [begin, end) with inf into output
+void inflate_stream(inflater& inf, const uint8_t* begin, const uint8_t* end, std::vector<uint8_t>& output)
 {
-    // read representation of code trees
-    const int hlit  = 257 + bs.get_bits(5);     // 5 Bits: HLIT, # of Literal/Length codes - 257 (257 - 286)
-    const int hdist = 1 + bs.get_bits(5);       // 5 Bits: HDIST, # of Distance codes - 1        (1 - 32)
-    const int hclen = 4 + bs.get_bits(4);       // 4 Bits: HCLEN, # of Code Length codes - 4     (4 - 19)
-
-    constexpr int max_code_lengths = 19;
-    uint8_t code_lengths[max_code_lengths]={0};
-    for (int i = 0; i < hclen; ++i) {
-        constexpr int alphabet_permute[max_code_lengths] = {
-            16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
-        };
-        code_lengths[alphabet_permute[i]] = static_cast<uint8_t>(bs.get_bits(3));
-    }
-
-    huffman_tree cl_tree = make_huffman_tree(make_huffman_table(code_lengths, code_lengths+max_code_lengths), 7);
-
-    number_of_lit_len_codes = hlit;
-    cl2.resize(hlit + hdist);
-    for (int i = 0; i < hlit + hdist;) {
-        auto cl_val = static_cast<uint8_t>(decode(cl_tree, bs));
-        int count = 1;
-        if (cl_val <= 15) {
-            // 0 - 15: Represent code lengths of 0 - 15
-        } else if (cl_val == 16) {
-            // 16: Copy the previous code length 3 - 6 times.
-            if (i == 0) {
-                return false;
-            }
-            cl_val = cl2[i-1];
-            // The next 2 bits indicate repeat length
-            // (0 = 3, ... , 3 = 6)
-            // Example:  Codes 8, 16 (+2 bits 11),
-            // 16 (+2 bits 10) will expand to
-            // 12 code lengths of 8 (1 + 6 + 5)
-            count = 3 + bs.get_bits(2);
-        } else if (cl_val == 17) {
-            // 17: Repeat a code length of 0 for 3 - 10 times.
-            // (3 bits of length)
-            cl_val = 0;
-            count = 3 + bs.get_bits(3);
-        } else {
-            // 18: Repeat a code length of 0 for 11 - 138 times
-            // (7 bits of length)
-            if (cl_val != 18) {
-                return false;
-            }
-            cl_val = 0;
-            count = 11 + bs.get_bits(7);
-        }
-        if (cl_val > max_bits || static_cast<size_t>(count + i) > cl2.size()) {
-            return false;
-        }
-        while (count--) {
-            cl2[i++] = cl_val;
+    // Start with the size of the last gzip member (usually the only one), which can't be trusted to be more than
+    // the input could possibly expand to
+    constexpr size_t max_expansion = 1032; // A 258 byte match per 2 bits
+    const size_t size_hint = inf.format() == stream_format::gzip ? std::min<size_t>(gzip_isize(begin, end), max_expansion * (end - begin)) : 0;
+
+    // Growing within the capacity of a reused output doesn't allocate, but filling it all would be wasted for small
+    // streams
+    output.resize(std::max(size_hint, std::min<size_t>(output.capacity(), 32768)));
+    size_t produced = 0;
+    for (;;) {
+        uint8_t* out = output.data() + produced;
+        const auto st = inf.inflate(begin, end, out, output.data() + output.size());
+        produced = out - output.data();
+        if (st == inflater::status::done) {
+            break;
+        } else if (st == inflater::status::need_input) {
+            throw_deflate_error(error_code::truncated);
         }
+        output.resize(std::max<size_t>(2 * output.size(), 32768));
     }
-
-    return true;
+    output.resize(produced);
 }
 
-std::vector<uint8_t> deflate(bit_stream& bs)
+std::vector<uint8_t> decompress(stream_format format, const uint8_t* begin, const uint8_t* end)
 {
-    auto invalid = [] () { assert(false); throw std::runtime_error("Invalid deflate stream"); };
+    inflater inf{format};
+    std::vector<uint8_t> output;
+    inflate_stream(inf, begin, end, output);
+    return output;
+}
 
-    static const auto default_lit_len_tree = make_huffman_tree(make_default_huffman_table(), 9);
-    static const auto default_dist_tree    = make_huffman_tree(make_default_huffman_len_table(), 5);
+std::vector<uint8_t> decompress(stream_format format, const uint8_t* begin, const uint8_t* end, const uint8_t* dictionary_begin, const uint8_t* dictionary_end)
+{
+    assert(format != stream_format::gzip);
+    inflater inf{format};
+    inf.set_dictionary(dictionary_begin, dictionary_end);
+    std::vector<uint8_t> output;
+    inflate_stream(inf, begin, end, output);
+    return output;
+}
 
-    output_buffer output;
-    bool last_block = false;
-    while (!last_block) {
-        // Block header bits
-        last_block = !!bs.get_bit();
-        const auto type  = static_cast<block_type>(bs.get_bits(2));
-        //std::cout << "final " << last_block << " type " << type << std::endl;
-        assert(type != block_type::reserved);
+void decompress(inflater& inf, const uint8_t* begin, const uint8_t* end, std::vector<uint8_t>& output)
+{
+    inf.reset();
+    inflate_stream(inf, begin, end, output);
+}
 
-        if (type == block_type::uncompressed) {
-            assert(false);
-            // skip any remaining bits in current partially
-            //     processed byte
-            //     read LEN and NLEN (each 16-bits)
-            //     copy LEN bytes of data to output
-        } else if (type == block_type::dynamic_huffman) {
+// Compress [begin, end) with [history, begin) as the preset dictionary, which for zlib has the Adler-32 dictionary_id
+std::vector<uint8_t> compress_stream(stream_format format, const uint8_t* history, const uint8_t* begin, const uint8_t* end, int level, const uint32_t* dictionary_id)
+{
+    std::vector<uint8_t> output;
+    if (format == stream_format::gzip) {
+        put_gzip_header(output, level);
+    } else if (format == stream_format::zlib) {
+        // CMF (deflate with a 32 KiB window) and FLG with FDICT, FLEVEL and the check bits
+        const uint32_t header = 0x7800 | ((level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6) | (dictionary_id ? 0x20 : 0);
+        put_framing_bytes(output, header + (31 - header % 31) % 31, 2, true);
+        if (dictionary_id) {
+            put_framing_bytes(output, *dictionary_id, 4, true);
+        }
+    }
 
-            std::vector<uint8_t> cl2;
-            int hlit;
-            if (!read_dynamic_huffman_code_lengths(bs, cl2, hlit)) {
-                invalid();
-            }
-            const auto lit_len_tree = make_huffman_tree(make_huffman_table(cl2.data(), cl2.data() + hlit), 9);
-            const auto dist_tree    = make_huffman_tree(make_huffman_table(cl2.data() + hlit, cl2.data() + cl2.size()), 6);
+    deflater{level}.compress(history, begin, end, true, output);
 
-            if (!deflate_inner(output, bs, lit_len_tree, dist_tree)) {
-                invalid();
-            }
-        } else if (type == block_type::fixed_huffman) {
-            if (!deflate_inner(output, bs, default_lit_len_tree, default_dist_tree)) {
-                invalid();
-            }
-        } else {
-            invalid();
-        }
+    if (format == stream_format::gzip) {
+        put_gzip_trailer(output, update_crc32(0, begin, end), static_cast<uint32_t>(end - begin));
+    } else if (format == stream_format::zlib) {
+        put_framing_bytes(output, update_adler32(1, begin, end), 4, true);
     }
-    return output.finish();
+    return output;
+}
+
+std::vector<uint8_t> compress(stream_format format, const uint8_t* begin, const uint8_t* end, int level)
+{
+    return compress_stream(format, begin, begin, end, level, nullptr);
+}
+
+std::vector<uint8_t> compress(stream_format format, const uint8_t* begin, const uint8_t* end, const uint8_t* dictionary_begin, const uint8_t* dictionary_end, int level)
+{
+    assert(format != stream_format::gzip);
+    // The deflater needs the history right before the input
+    const auto history_size = std::min<ptrdiff_t>(dictionary_end - dictionary_begin, max_distance);
+    std::vector<uint8_t> input(dictionary_end - history_size, dictionary_end);
+    input.insert(input.end(), begin, end);
+    const uint32_t dictionary_id = update_adler32(1, dictionary_begin, dictionary_end);
+    return compress_stream(format, input.data(), input.data() + history_size, input.data() + input.size(), level, &dictionary_id);
 }
 
 } // namespace deflate
@@ -2,12 +2,42 @@
 #define DEFLATE_DEFLATE_H
 
 #include "bit_stream.h"
+#include "inflater.h"
+#include "deflater.h"
 #include <vector>
 
 namespace deflate {
 
 std::vector<uint8_t> deflate(bit_stream& bs);
 
+// Decompress a raw deflate stream from bs straight into [out, out_end), returning the size of the output. Throws
+// std::runtime_error if it's invalid, truncated or doesn't fit.
+size_t deflate(bit_stream& bs, uint8_t* out, uint8_t* out_end);
+
+// Decompress a complete stream (for gzip every member). Throws std::runtime_error if it's invalid or truncated.
+std::vector<uint8_t> decompress(stream_format format, const uint8_t* begin, const uint8_t* end);
+
+// Like the above using inf, which is reset() first, decompressing into output (replacing its contents). Reusing both
+// avoids all allocations once output has grown to fit.
+void decompress(inflater& inf, const uint8_t* begin, const uint8_t* end, std::vector<uint8_t>& output);
+
+// Compress [begin, end) as a complete stream using the given level (0-9)
+std::vector<uint8_t> compress(stream_format format, const uint8_t* begin, const uint8_t* end, int level = default_compression_level);
+
+// Decompress a complete stream straight into [out, out_end) (e.g. sized by gzip_isize()) without any intermediate
+// buffer, returning the size of the output. Throws std::runtime_error if it's invalid, truncated or doesn't fit.
+size_t decompress(stream_format format, const uint8_t* begin, const uint8_t* end, uint8_t* out, uint8_t* out_end);
+
+// The ISIZE field of the last gzip member in [begin, end), which for a single member is the output size modulo 2^32.
+// 0 if the input is too short to be gzip.
+uint32_t gzip_isize(const uint8_t* begin, const uint8_t* end);
+
+// Like the first decompress(), with [dictionary_begin, dictionary_end) as the preset dictionary (only its last 32 KiB are used).
+// Small inputs similar to the dictionary compress much better. Only for raw and zlib streams, zlib streams record the
+// dictionary's Adler-32 in the header (FDICT).
+std::vector<uint8_t> decompress(stream_format format, const uint8_t* begin, const uint8_t* end, const uint8_t* dictionary_begin, const uint8_t* dictionary_end);
+std::vector<uint8_t> compress(stream_format format, const uint8_t* begin, const uint8_t* end, const uint8_t* dictionary_begin, const uint8_t* dictionary_end, int level = default_compression_level);
+
 } // namespace deflate
 
 #endif
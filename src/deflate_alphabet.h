@@ -0,0 +1,37 @@
+#ifndef DEFLATE_DEFLATE_ALPHABET_H
+#define DEFLATE_DEFLATE_ALPHABET_H
+
+namespace deflate {
+
+// Literal/length alphabet (rfc1951 3.2.5)
+enum lit_len_alphabet {
+    lit_min      = 0,
+    lit_max      = 255,
+    end_of_block = 256,
+    len_min      = 257,
+    len_max      = 285,
+};
+
+constexpr int num_length_codes   = 1 + len_max - len_min;
+constexpr int num_distance_codes = 30;
+
+constexpr int length_extra_bits[num_length_codes] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+constexpr int length_base[num_length_codes] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+constexpr int distance_extra_bits[num_distance_codes] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+constexpr int distance_base[num_distance_codes] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+};
+
+// Order the code length code lengths of a dynamic block are stored in (rfc1951 3.2.7)
+constexpr int num_code_length_codes = 19;
+constexpr int code_length_order[num_code_length_codes] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+} // namespace deflate
+
+#endif
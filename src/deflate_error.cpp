@@ -0,0 +1,31 @@
+#include "deflate_error.h"
+
+namespace deflate {
+
+const char* error_message(error_code code)
+{
+    switch (code) {
+    case error_code::truncated:             return "Truncated stream";
+    case error_code::invalid_block_type:    return "Invalid deflate stream: reserved block type";
+    case error_code::invalid_stored_length: return "Invalid deflate stream: stored block length mismatch";
+    case error_code::invalid_code_lengths:  return "Invalid deflate stream: invalid code lengths";
+    case error_code::invalid_symbol:        return "Invalid deflate stream: invalid symbol";
+    case error_code::invalid_distance:      return "Invalid deflate stream: distance too far back";
+    case error_code::invalid_gzip_header:   return "Invalid gzip header";
+    case error_code::invalid_zlib_header:   return "Invalid zlib header";
+    case error_code::crc32_mismatch:        return "gzip CRC-32 mismatch";
+    case error_code::isize_mismatch:        return "gzip ISIZE mismatch";
+    case error_code::adler32_mismatch:      return "zlib Adler-32 mismatch";
+    case error_code::dictionary_required:   return "zlib preset dictionary required";
+    case error_code::dictionary_mismatch:   return "zlib preset dictionary mismatch";
+    case error_code::output_too_small:      return "Output buffer too small";
+    }
+    return "Unknown error";
+}
+
+void throw_deflate_error(error_code code)
+{
+    throw deflate_error{code};
+}
+
+} // namespace deflate
@@ -0,0 +1,48 @@
+#ifndef DEFLATE_DEFLATE_ERROR_H
+#define DEFLATE_DEFLATE_ERROR_H
+
+#include <stdexcept>
+
+namespace deflate {
+
+// Why a stream was rejected. Decoders check every input dependent value (the bit_stream supplies zero bits past the
+// end of the input and decode tables mark unused codes invalid) so malformed input always ends in one of these,
+// never in an assert or a read or write out of bounds.
+enum class error_code {
+    truncated,             // The input ended before the end of the stream
+    invalid_block_type,    // Reserved block type (3)
+    invalid_stored_length, // LEN and NLEN of a stored block don't match
+    invalid_code_lengths,  // Code lengths of a dynamic block are out of range or describe an over-subscribed or incomplete code
+    invalid_symbol,        // Unused length or distance code
+    invalid_distance,      // Distance further back than the start of the output
+    invalid_gzip_header,
+    invalid_zlib_header,
+    crc32_mismatch,        // gzip trailer
+    isize_mismatch,        // gzip trailer
+    adler32_mismatch,      // zlib trailer
+    dictionary_required,   // zlib stream with a preset dictionary that wasn't supplied
+    dictionary_mismatch,   // zlib preset dictionary with the wrong DICTID
+    output_too_small,      // Caller supplied output buffer can't hold the output
+};
+
+const char* error_message(error_code code);
+
+// Thrown for malformed input. Derives from std::runtime_error with error_message() as what().
+class deflate_error : public std::runtime_error {
+public:
+    explicit deflate_error(error_code code) : std::runtime_error(error_message(code)), code_(code) {
+    }
+
+    error_code code() const {
+        return code_;
+    }
+
+private:
+    error_code code_;
+};
+
+[[noreturn]] void throw_deflate_error(error_code code);
+
+} // namespace deflate
+
+#endif
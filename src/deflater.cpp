@@ -0,0 +1,580 @@
+#include "deflater.h"
+#include "bit_writer.h"
+#include "code_lengths.h"
+#include "deflate_alphabet.h"
+#include "huffman_code.h"
+#include "huffman_table.h"
+#include "output_buffer.h"
+
+#include <string.h>
+#include <algorithm>
+#include <cassert>
+
+namespace deflate {
+
+// Match search settings for a level (as zlib's configuration_table)
+struct compression_params {
+    int  good_length; // Search a quarter of the chain when the previous match is at least this long
+    int  max_lazy;    // Lazy: don't look for a longer match after one this long. Greedy: longest match whose positions
+                      // are all added to the hash chains.
+    int  nice_length; // Stop searching once a match is this long
+    int  max_chain;   // Candidates to check at most
+    bool lazy;
+};
+
+constexpr compression_params compression_levels[10] = {
+    {  0,   0,   0,    0, false },
+    {  4,   4,   8,    4, false },
+    {  4,   5,  16,    8, false },
+    {  4,   6,  32,   32, false },
+    {  4,   4,  16,   16, true  },
+    {  8,  16,  32,   32, true  },
+    {  8,  16, 128,  128, true  },
+    {  8,  32, 128,  256, true  },
+    { 32, 128, 258, 1024, true  },
+    { 32, 258, 258, 4096, true  },
+};
+
+constexpr int min_match_length = 3;
+constexpr int hash_bits        = 15;
+constexpr int block_tokens     = 1 << 14; // Literals and matches per block at most
+constexpr int segment_tokens   = 1 << 10; // Literals and matches per block splitting decision
+constexpr int max_stored_block = 65535;
+
+// Assumed cost of the header of another block
+constexpr float split_penalty_bits = 500;
+
+// A match of the minimum length this far back costs more than the literals
+constexpr int too_far = 4096;
+
+constexpr int num_lit_len_codes   = len_max + 1;
+
+struct lz77_code_tables {
+    uint8_t length_code[max_match_length + 1];
+    uint8_t distance_code[512]; // Distances up to 256 at distance-1, longer ones at 256 + (distance-1)/128
+
+    int distance_index(int distance) const {
+        return distance <= 256 ? distance - 1 : 256 + ((distance - 1) >> 7);
+    }
+};
+
+const lz77_code_tables& lz77_codes()
+{
+    static const lz77_code_tables tables = [] {
+        lz77_code_tables t{};
+        for (int c = 0; c < num_length_codes; ++c) {
+            for (int len = length_base[c]; len < length_base[c] + (1 << length_extra_bits[c]) && len <= max_match_length; ++len) {
+                t.length_code[len] = static_cast<uint8_t>(c);
+            }
+        }
+        for (int c = 0; c < num_distance_codes; ++c) {
+            for (int dist = distance_base[c]; dist < distance_base[c] + (1 << distance_extra_bits[c]); ++dist) {
+                t.distance_code[t.distance_index(dist)] = static_cast<uint8_t>(c);
+            }
+        }
+        return t;
+    }();
+    return tables;
+}
+
+// Literal/length and distance symbol counts of a run of tokens
+struct symbol_histogram {
+    uint32_t lit_len[num_lit_len_codes];
+    uint32_t dist[num_distance_codes];
+
+    template<typename Token>
+    void add_tokens(const Token* begin, const Token* end) {
+        const auto& codes = lz77_codes();
+        for (auto t = begin; t != end; ++t) {
+            if (!t->length) {
+                ++lit_len[t->value];
+            } else {
+                ++lit_len[len_min + codes.length_code[t->length]];
+                ++dist[codes.distance_code[codes.distance_index(t->value)]];
+            }
+        }
+    }
+
+    void add(const symbol_histogram& h) {
+        for (int i = 0; i < num_lit_len_codes; ++i) {
+            lit_len[i] += h.lit_len[i];
+        }
+        for (int i = 0; i < num_distance_codes; ++i) {
+            dist[i] += h.dist[i];
+        }
+    }
+};
+
+// log2(x) for x > 0 to within 0.01, from the exponent and a parabola through the mantissa. Zero gives a finite value.
+float approximate_log2(float x)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    const int exponent = static_cast<int>(bits >> 23) - 127;
+    bits = (bits & 0x7fffff) | 0x3f800000;
+    float m;
+    memcpy(&m, &bits, sizeof(m));
+    return static_cast<float>(exponent) + (-0.34484843f * m + 2.02466578f) * m - 0.67487759f;
+}
+
+// Bits to code symbols with these counts with an ideal code for them
+float entropy_bits(const uint32_t* counts, int num_symbols)
+{
+    float bits = 0;
+    uint32_t total = 0;
+    for (int i = 0; i < num_symbols; ++i) {
+        const auto n = static_cast<float>(counts[i]);
+        bits -= n * approximate_log2(n);
+        total += counts[i];
+    }
+    return bits + total * approximate_log2(static_cast<float>(total));
+}
+
+// Estimated bits for the symbols of a block, without its header and the extra bits
+float estimated_bits(const symbol_histogram& h)
+{
+    return entropy_bits(h.lit_len, num_lit_len_codes) + entropy_bits(h.dist, num_distance_codes);
+}
+
+// Canonical codes for the code lengths, bit reversed for writing
+void make_writer_codes(const uint8_t* lengths, int num_symbols, huffman_code* codes)
+{
+    const auto table = make_huffman_table(lengths, lengths + num_symbols);
+    for (int i = 0; i < num_symbols; ++i) {
+        codes[i] = table[i];
+        codes[i].value = static_cast<uint16_t>(reversed_code(table[i].value, table[i].len));
+    }
+}
+
+void write_stored_blocks(bit_writer& w, const uint8_t* data, size_t size, bool last)
+{
+    do {
+        const auto n = std::min<size_t>(size, max_stored_block);
+        w.reserve(8);
+        w.add_bits(last && n == size ? 1 : 0, 3);
+        w.align_to_byte();
+        w.add_bits(n | ((n ^ 0xffff) << 16), 32);
+        w.flush_bits();
+        w.put_bytes(data, n);
+        data += n;
+        size -= n;
+    } while (size);
+}
+
+// Bits of stored blocks holding size bytes when pending_bits bits are pending in the bit_writer
+uint64_t stored_block_bits(size_t size, int pending_bits)
+{
+    const uint64_t num_stored = std::max<uint64_t>(1, (size + max_stored_block - 1) / max_stored_block);
+    return 3 + (8 - (pending_bits + 3) % 8) % 8 + num_stored * 32 + (num_stored - 1) * 8 + 8 * static_cast<uint64_t>(size);
+}
+
+// Write the tokens [tokens, tokens_end), which encode [raw, raw+raw_size) and have the symbol counts h, as a block (or
+// stored blocks), whichever representation is smallest. [stored, raw) is input of preceding blocks that were best
+// stored, which isn't written yet so that consecutive stored blocks can be merged, and a block that is best stored
+// too only joins it unless it's the last one. Returns where the input that is still to be stored starts.
+template<typename Token>
+const uint8_t* write_block(bit_writer& w, const Token* tokens, const Token* tokens_end, const symbol_histogram& h, const uint8_t* stored, const uint8_t* raw, size_t raw_size, bool last)
+{
+    static const struct fixed_codes {
+        uint8_t      lit_len_lengths[num_lit_len_codes];
+        uint8_t      dist_lengths[num_distance_codes];
+        huffman_code lit_len[num_lit_len_codes];
+        huffman_code dist[num_distance_codes];
+    } fixed = [] {
+        fixed_codes c{};
+        // rfc1951 3.2.6 (the table also includes the unused codes 286 and 287)
+        uint8_t lengths[288];
+        std::fill(lengths, lengths + 144, static_cast<uint8_t>(8));
+        std::fill(lengths + 144, lengths + 256, static_cast<uint8_t>(9));
+        std::fill(lengths + 256, lengths + 280, static_cast<uint8_t>(7));
+        std::fill(lengths + 280, lengths + 288, static_cast<uint8_t>(8));
+        huffman_code codes[288];
+        make_writer_codes(lengths, 288, codes);
+        std::copy(lengths, lengths + num_lit_len_codes, c.lit_len_lengths);
+        std::copy(codes, codes + num_lit_len_codes, c.lit_len);
+        std::fill(c.dist_lengths, c.dist_lengths + num_distance_codes, static_cast<uint8_t>(5));
+        make_writer_codes(c.dist_lengths, num_distance_codes, c.dist);
+        return c;
+    }();
+    const auto& codes = lz77_codes();
+
+    uint32_t lit_len_freq[num_lit_len_codes];
+    std::copy(h.lit_len, h.lit_len + num_lit_len_codes, lit_len_freq);
+    const uint32_t* const dist_freq = h.dist;
+    lit_len_freq[end_of_block] = 1;
+
+    uint64_t extra_bits = 0;
+    for (int c = 0; c < num_length_codes; ++c) {
+        extra_bits += static_cast<uint64_t>(lit_len_freq[len_min + c]) * length_extra_bits[c];
+    }
+    for (int c = 0; c < num_distance_codes; ++c) {
+        extra_bits += static_cast<uint64_t>(dist_freq[c]) * distance_extra_bits[c];
+    }
+    auto data_bits = [&](const uint8_t* lit_len_lengths, const uint8_t* dist_lengths) {
+        uint64_t bits = extra_bits;
+        for (int i = 0; i < num_lit_len_codes; ++i) {
+            bits += static_cast<uint64_t>(lit_len_freq[i]) * lit_len_lengths[i];
+        }
+        for (int i = 0; i < num_distance_codes; ++i) {
+            bits += static_cast<uint64_t>(dist_freq[i]) * dist_lengths[i];
+        }
+        return bits;
+    };
+
+    // Dynamic code, the code lengths are sent run-length encoded with the code length code
+    uint8_t lengths[num_lit_len_codes + num_distance_codes];
+    make_code_lengths(lit_len_freq, num_lit_len_codes, max_bits, lengths);
+    make_code_lengths(dist_freq, num_distance_codes, max_bits, lengths + num_lit_len_codes);
+    int hlit = num_lit_len_codes;
+    while (hlit > 257 && !lengths[hlit - 1]) {
+        --hlit;
+    }
+    int hdist = num_distance_codes;
+    while (hdist > 1 && !lengths[num_lit_len_codes + hdist - 1]) {
+        --hdist;
+    }
+    // The distance code lengths follow the used literal/length code lengths directly (runs may cross over)
+    uint8_t sequence[num_lit_len_codes + num_distance_codes];
+    std::copy(lengths, lengths + hlit, sequence);
+    std::copy(lengths + num_lit_len_codes, lengths + num_lit_len_codes + hdist, sequence + hlit);
+    code_length_symbol cl_symbols[num_lit_len_codes + num_distance_codes];
+    const int num_cl_symbols = encode_code_lengths(sequence, hlit + hdist, cl_symbols);
+    uint32_t cl_freq[num_code_length_codes] = {};
+    for (int i = 0; i < num_cl_symbols; ++i) {
+        ++cl_freq[cl_symbols[i].symbol];
+    }
+    uint8_t cl_lengths[num_code_length_codes];
+    make_code_lengths(cl_freq, num_code_length_codes, 7, cl_lengths);
+    int hclen = num_code_length_codes;
+    while (hclen > 4 && !cl_lengths[code_length_order[hclen - 1]]) {
+        --hclen;
+    }
+    uint64_t dynamic_bits = 3 + 5 + 5 + 4 + 3 * hclen + data_bits(lengths, lengths + num_lit_len_codes);
+    for (int i = 0; i < num_code_length_codes; ++i) {
+        dynamic_bits += static_cast<uint64_t>(cl_freq[i]) * (cl_lengths[i] + code_length_extra_bits[i]);
+    }
+
+    const uint64_t fixed_bits  = 3 + data_bits(fixed.lit_len_lengths, fixed.dist_lengths);
+    const size_t   stored_size = raw - stored;
+    const uint64_t stored_bits = stored_block_bits(stored_size + raw_size, w.pending_bits()) - (stored_size ? stored_block_bits(stored_size, w.pending_bits()) : 0);
+
+    if (stored_bits <= std::min(fixed_bits, dynamic_bits)) {
+        if (!last) {
+            return stored;
+        }
+        write_stored_blocks(w, stored, stored_size + raw_size, true);
+        return raw + raw_size;
+    }
+    if (stored_size) {
+        write_stored_blocks(w, stored, stored_size, false);
+    }
+
+    huffman_code dynamic_lit_len[num_lit_len_codes];
+    huffman_code dynamic_dist[num_distance_codes];
+    const huffman_code* lit_len_codes = fixed.lit_len;
+    const huffman_code* dist_codes    = fixed.dist;
+    w.reserve(std::min(fixed_bits, dynamic_bits) / 8 + 8);
+    if (dynamic_bits < fixed_bits) {
+        w.add_bits(last ? 5 : 4, 3);
+        w.add_bits(hlit - 257, 5);
+        w.add_bits(hdist - 1, 5);
+        w.add_bits(hclen - 4, 4);
+        w.flush_bits();
+        for (int i = 0; i < hclen; ++i) {
+            w.add_bits(cl_lengths[code_length_order[i]], 3);
+            w.flush_bits();
+        }
+        huffman_code cl_codes[num_code_length_codes];
+        make_writer_codes(cl_lengths, num_code_length_codes, cl_codes);
+        for (int i = 0; i < num_cl_symbols; ++i) {
+            const auto& cs = cl_symbols[i];
+            w.add_code(cl_codes[cs.symbol]);
+            w.add_bits(cs.extra, code_length_extra_bits[cs.symbol]);
+            w.flush_bits();
+        }
+        make_writer_codes(lengths, num_lit_len_codes, dynamic_lit_len);
+        make_writer_codes(lengths + num_lit_len_codes, num_distance_codes, dynamic_dist);
+        lit_len_codes = dynamic_lit_len;
+        dist_codes    = dynamic_dist;
+    } else {
+        w.add_bits(last ? 3 : 2, 3);
+    }
+
+    // A match takes at most 48 bits, so the up to 7 bits left by flush_bits() always fit with it
+    for (; tokens != tokens_end; ++tokens) {
+        const auto& t = *tokens;
+        if (!t.length) {
+            w.add_code(lit_len_codes[t.value]);
+        } else {
+            const int lc = codes.length_code[t.length];
+            w.add_code(lit_len_codes[len_min + lc]);
+            w.add_bits(t.length - length_base[lc], length_extra_bits[lc]);
+            const int dc = codes.distance_code[codes.distance_index(t.value)];
+            w.add_code(dist_codes[dc]);
+            w.add_bits(t.value - distance_base[dc], distance_extra_bits[dc]);
+        }
+        w.flush_bits();
+    }
+    w.add_code(lit_len_codes[end_of_block]);
+    w.flush_bits();
+    return raw + raw_size;
+}
+
+// Number of equal bytes (up to max_len) at a and b
+int common_length(const uint8_t* a, const uint8_t* b, int max_len)
+{
+    int len = 0;
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; len + 8 <= max_len; len += 8) {
+        uint64_t x, y;
+        memcpy(&x, a + len, sizeof(x));
+        memcpy(&y, b + len, sizeof(y));
+        if (x != y) {
+            return len + (__builtin_ctzll(x ^ y) >> 3);
+        }
+    }
+#endif
+    while (len < max_len && a[len] == b[len]) {
+        ++len;
+    }
+    return len;
+}
+
+uint32_t hash3(const uint8_t* p)
+{
+    const uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+    return (v * 0x9e3779b1u) >> (32 - hash_bits);
+}
+
+// Positions in the chains are never this far back
+constexpr int32_t no_position = -max_distance - 1;
+
+deflater::deflater(int level, size_t window_size)
+    : level_(level)
+    , window_size_(static_cast<ptrdiff_t>(window_size))
+    , head_(1 << hash_bits)
+    , prev_(max_distance)
+{
+    assert(level >= 0 && level <= 9);
+    assert(window_size > 0 && window_size <= max_window_size);
+    tokens_.reserve(block_tokens);
+}
+
+// Add pos to its hash chain, returning the previous position with the same hash
+int32_t deflater::insert(const uint8_t* base, int32_t pos)
+{
+    const auto h = hash3(base + pos);
+    const auto candidate = head_[h];
+    prev_[pos & (max_distance - 1)] = candidate;
+    head_[h] = pos;
+    return candidate;
+}
+
+// Search the chain from candidate for a match at pos longer than prev_length. Returns its length (0 if none was
+// found) and sets distance.
+int deflater::longest_match(const uint8_t* base, int32_t pos, int32_t size, int32_t candidate, int prev_length, int& distance) const
+{
+    const auto& params = compression_levels[level_];
+    int chain = prev_length >= params.good_length ? params.max_chain >> 2 : params.max_chain;
+    const int max_len = std::min(max_match_length, size - pos);
+    const uint8_t* const s = base + pos;
+    int best = prev_length;
+    if (best >= max_len) {
+        return 0;
+    }
+    bool found = false;
+    // prev_ holds valid links for the positions at distances below max_distance
+    for (const int32_t limit = pos - max_distance; candidate > limit && chain--; candidate = prev_[candidate & (max_distance - 1)]) {
+        const uint8_t* const m = base + candidate;
+        if (m[best] != s[best] || m[0] != s[0] || m[1] != s[1]) {
+            continue;
+        }
+        const int len = common_length(m, s, max_len);
+        if (len > best) {
+            best     = len;
+            distance = pos - candidate;
+            found    = true;
+            if (len >= params.nice_length || len == max_len) {
+                break;
+            }
+        }
+    }
+    return found ? best : 0;
+}
+
+void deflater::compress(const uint8_t* history, const uint8_t* begin, const uint8_t* end, bool last, std::vector<uint8_t>& out)
+{
+    assert(history <= begin && begin <= end);
+    bit_writer w{out};
+    // Level 0 stores, but an empty final block is shorter as a fixed Huffman block
+    if (level_ == 0 && begin != end) {
+        write_stored_blocks(w, begin, end - begin, last);
+    } else {
+        // Positions in a window (and its history) fit in an int32_t
+        do {
+            const auto window_end = begin + std::min<ptrdiff_t>(end - begin, window_size_);
+            compress_window(w, history, begin, window_end, last && window_end == end);
+            begin = window_end;
+        } while (begin != end);
+    }
+
+    if (!last) {
+        // Sync flush
+        write_stored_blocks(w, nullptr, 0, false);
+    }
+    w.finish();
+}
+
+// Write blocks encoding [begin, end) with matches into the up to 32 KiB of [history, begin)
+void deflater::compress_window(bit_writer& w, const uint8_t* history, const uint8_t* begin, const uint8_t* end, bool last)
+{
+    const auto& params = compression_levels[level_];
+    const uint8_t* const base = begin - std::min<ptrdiff_t>(begin - history, max_distance);
+    const auto size  = static_cast<int32_t>(end - base);
+    const auto start = static_cast<int32_t>(begin - base);
+
+    std::fill(head_.begin(), head_.end(), no_position);
+    for (int32_t pos = 0; pos < start && pos + 2 < size; ++pos) {
+        insert(base, pos);
+    }
+
+    // The tokens are counted in segments. A segment whose symbols are distributed differently enough from those of
+    // the block so far that a new block pays for its header starts one.
+    tokens_.clear();
+    symbol_histogram block{};
+    float   block_bits    = 0;
+    size_t  segment_begin = 0;     // Index of the segment's first token
+    int32_t block_start   = start;
+    int32_t segment_start = start;
+    int32_t covered       = start; // Input encoded by tokens_ ends here
+    const uint8_t* stored = base + start; // Input of blocks to be stored that isn't written yet starts here
+    auto end_segment = [&] {
+        symbol_histogram segment{};
+        segment.add_tokens(tokens_.data() + segment_begin, tokens_.data() + tokens_.size());
+        const float segment_bits = estimated_bits(segment);
+        symbol_histogram combined = block;
+        combined.add(segment);
+        const float combined_bits = estimated_bits(combined);
+        if (segment_begin && block_bits + segment_bits + split_penalty_bits < combined_bits) {
+            stored = write_block(w, tokens_.data(), tokens_.data() + segment_begin, block, stored, base + block_start, segment_start - block_start, false);
+            tokens_.erase(tokens_.begin(), tokens_.begin() + segment_begin);
+            block       = segment;
+            block_bits  = segment_bits;
+            block_start = segment_start;
+        } else {
+            block      = combined;
+            block_bits = combined_bits;
+        }
+        segment_begin = tokens_.size();
+        segment_start = covered;
+    };
+    auto add_token = [&](int length, int value, int32_t new_covered) {
+        tokens_.push_back({static_cast<uint16_t>(length), static_cast<uint16_t>(value)});
+        covered = new_covered;
+        if (tokens_.size() - segment_begin == segment_tokens) {
+            end_segment();
+            if (tokens_.size() >= block_tokens) {
+                stored = write_block(w, tokens_.data(), tokens_.data() + tokens_.size(), block, stored, base + block_start, covered - block_start, false);
+                tokens_.clear();
+                block         = symbol_histogram{};
+                block_bits    = 0;
+                segment_begin = 0;
+                block_start   = covered;
+            }
+        }
+    };
+    auto find_match = [&](int32_t pos, int prev_length, int& distance) {
+        if (pos + 2 >= size) {
+            return 0;
+        }
+        const auto candidate = insert(base, pos);
+        if (prev_length >= params.max_lazy && params.lazy) {
+            return 0;
+        }
+        const int len = longest_match(base, pos, size, candidate, std::max(prev_length, min_match_length - 1), distance);
+        return len == min_match_length && distance > too_far ? 0 : len;
+    };
+
+    if (!params.lazy) {
+        for (int32_t pos = start; pos < size;) {
+            int distance = 0;
+            const int len = find_match(pos, 0, distance);
+            if (len) {
+                add_token(len, distance, pos + len);
+                if (len <= params.max_lazy) {
+                    for (int32_t p = pos + 1; p < pos + len && p + 2 < size; ++p) {
+                        insert(base, p);
+                    }
+                }
+                pos += len;
+            } else {
+                add_token(0, base[pos], pos + 1);
+                ++pos;
+            }
+        }
+    } else {
+        // A match (or literal) at pos-1 is pending until it's known that there's no longer match at pos
+        int  prev_len      = 0;
+        int  prev_distance = 0;
+        bool pending       = false;
+        for (int32_t pos = start; pos < size;) {
+            int distance = 0;
+            const int len = find_match(pos, prev_len, distance);
+            if (prev_len >= min_match_length && len <= prev_len) {
+                add_token(prev_len, prev_distance, pos - 1 + prev_len);
+                for (int32_t p = pos + 1; p < pos - 1 + prev_len && p + 2 < size; ++p) {
+                    insert(base, p);
+                }
+                pos      = pos - 1 + prev_len;
+                prev_len = 0;
+                pending  = false;
+            } else {
+                if (pending) {
+                    add_token(0, base[pos - 1], pos);
+                }
+                pending       = true;
+                prev_len      = len;
+                prev_distance = distance;
+                ++pos;
+            }
+        }
+        if (pending) {
+            add_token(0, base[size - 1], size);
+        }
+    }
+    assert(covered == size);
+    if (tokens_.size() > segment_begin) {
+        end_segment();
+    }
+    if (!tokens_.empty() || last) {
+        stored = write_block(w, tokens_.data(), tokens_.data() + tokens_.size(), block, stored, base + block_start, covered - block_start, last);
+    }
+    if (stored != base + covered) {
+        write_stored_blocks(w, stored, base + covered - stored, false);
+    }
+}
+
+void put_framing_bytes(std::vector<uint8_t>& out, uint32_t value, int bytes, bool big_endian)
+{
+    assert(bytes > 0 && bytes <= 4);
+    for (int i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * (big_endian ? bytes - 1 - i : i))));
+    }
+}
+
+void put_gzip_header(std::vector<uint8_t>& out, int level)
+{
+    // ID1 ID2 CM FLG, MTIME, XFL (2: maximum compression, 4: fastest) and OS (unknown)
+    put_framing_bytes(out, 0x00088b1f, 4, false);
+    put_framing_bytes(out, 0, 4, false);
+    out.push_back(level == 9 ? 2 : level == 1 ? 4 : 0);
+    out.push_back(255);
+}
+
+void put_gzip_trailer(std::vector<uint8_t>& out, uint32_t crc, uint32_t size)
+{
+    put_framing_bytes(out, crc, 4, false);
+    put_framing_bytes(out, size, 4, false);
+}
+
+} // namespace deflate
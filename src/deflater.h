@@ -0,0 +1,59 @@
+#ifndef DEFLATE_DEFLATER_H
+#define DEFLATE_DEFLATER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace deflate {
+
+class bit_writer;
+
+constexpr int    default_compression_level = 6;
+constexpr size_t max_window_size           = 1 << 30;
+
+// Deflate compressor for data in memory.
+//
+// Matches are found through hash chains of the positions whose next 3 bytes hash alike. Levels 1-3 take the longest
+// match found at each position (greedy), levels 4-9 first check whether the next position has a longer one (lazy),
+// and higher levels search longer chains, like zlib's levels. Level 0 only stores. A block ends where the estimated
+// cost of the literals and matches that follow is lower in a block of their own, and is written stored or with the
+// fixed or a dynamic Huffman code, whichever is smallest. The input is searched in windows of window_size bytes (which
+// each end a block), so positions in them fit in 32 bits.
+class deflater {
+public:
+    explicit deflater(int level = default_compression_level, size_t window_size = max_window_size);
+
+    // Compress [begin, end) appending deflate blocks to out. Matches may reference the up to 32 KiB of [history,
+    // begin) before begin (history == begin for none). If last the final block ends the stream, otherwise an empty
+    // stored block (a sync flush) ends the output at a byte boundary, and more data can be compressed with another
+    // call.
+    void compress(const uint8_t* history, const uint8_t* begin, const uint8_t* end, bool last, std::vector<uint8_t>& out);
+
+private:
+    struct token {
+        uint16_t length; // 0 for a literal
+        uint16_t value;  // Literal byte or match distance
+    };
+
+    int                  level_;
+    ptrdiff_t            window_size_;
+    std::vector<int32_t> head_; // Most recent position for each hash value
+    std::vector<int32_t> prev_; // Previous position with the same hash, indexed by position modulo 32 KiB
+    std::vector<token>   tokens_;
+
+    void compress_window(bit_writer& w, const uint8_t* history, const uint8_t* begin, const uint8_t* end, bool last);
+    int32_t insert(const uint8_t* base, int32_t pos);
+    int longest_match(const uint8_t* base, int32_t pos, int32_t size, int32_t candidate, int prev_length, int& distance) const;
+};
+
+// Append a value of bytes (at most 4) bytes, least significant first unless big_endian
+void put_framing_bytes(std::vector<uint8_t>& out, uint32_t value, int bytes, bool big_endian);
+
+// Header (without optional fields) and trailer of a gzip member (rfc1952 2.3) compressed at level
+void put_gzip_header(std::vector<uint8_t>& out, int level);
+void put_gzip_trailer(std::vector<uint8_t>& out, uint32_t crc, uint32_t size);
+
+} // namespace deflate
+
+#endif
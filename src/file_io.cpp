@@ -0,0 +1,127 @@
+#include "file_io.h"
+#include "deflate_error.h"
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fstream>
+#include <new>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace deflate {
+
+[[noreturn]] void throw_file_error(const std::string& what)
+{
+    throw std::runtime_error(what + ": " + strerror(errno));
+}
+
+#if defined(_WIN32)
+mapped_file::mapped_file(const std::string& filename)
+{
+    std::ifstream in(filename, std::ios_base::binary);
+    if (!in) throw std::runtime_error(filename + " not found");
+    in.seekg(0, std::ios_base::end);
+    size_ = static_cast<size_t>(in.tellg());
+    in.seekg(0, std::ios_base::beg);
+    auto data = new uint8_t[size_ ? size_ : 1];
+    if (!in.read(reinterpret_cast<char*>(data), size_)) {
+        delete[] data;
+        throw std::runtime_error(filename + ": read failed");
+    }
+    data_ = data;
+}
+
+mapped_file::~mapped_file()
+{
+    delete[] data_;
+}
+
+void write_fd(int fd, const uint8_t* data, size_t size)
+{
+    while (size) {
+        const auto n = _write(fd, data, static_cast<unsigned>(std::min<size_t>(size, 1 << 30)));
+        if (n < 0) throw_file_error("write failed");
+        data += n;
+        size -= n;
+    }
+}
+#else
+mapped_file::mapped_file(const std::string& filename)
+{
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) throw_file_error(filename);
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        const int e = errno;
+        close(fd);
+        errno = e;
+        throw_file_error(filename);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_) {
+        // The mapping stays valid after the descriptor is closed
+        void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        const int e = errno;
+        close(fd);
+        if (p == MAP_FAILED) {
+            errno = e;
+            throw_file_error(filename);
+        }
+        madvise(p, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const uint8_t*>(p);
+    } else {
+        close(fd);
+    }
+}
+
+mapped_file::~mapped_file()
+{
+    if (size_) {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+}
+
+void write_fd(int fd, const uint8_t* data, size_t size)
+{
+    while (size) {
+        const auto n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw_file_error("write failed");
+        }
+        data += n;
+        size -= n;
+    }
+}
+#endif
+
+uint64_t decompress_to_fd(stream_format format, const uint8_t* begin, const uint8_t* end, int fd)
+{
+    inflater inf{format};
+    uint64_t total = 0;
+    for (;;) {
+        const uint8_t* data;
+        size_t size;
+        const auto st = inf.inflate(begin, end, data, size);
+        if (size) {
+            write_fd(fd, data, size);
+            total += size;
+        }
+        if (st == inflater::status::done) {
+            return total;
+        } else if (st == inflater::status::need_input) {
+            throw_deflate_error(error_code::truncated);
+        }
+    }
+}
+
+} // namespace deflate
@@ -0,0 +1,49 @@
+#ifndef DEFLATE_FILE_IO_H
+#define DEFLATE_FILE_IO_H
+
+#include "inflater.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace deflate {
+
+// Read-only memory map of a whole file, advised for sequential access. Where mmap() isn't available the file is read
+// into memory instead. Throws std::runtime_error if the file can't be opened.
+class mapped_file {
+public:
+    explicit mapped_file(const std::string& filename);
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const uint8_t* begin() const {
+        return data_;
+    }
+
+    const uint8_t* end() const {
+        return data_ + size_;
+    }
+
+    uint64_t size() const {
+        return size_;
+    }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t         size_ = 0;
+};
+
+// Write all of [data, data + size) to the file descriptor. Throws std::runtime_error on failure.
+void write_fd(int fd, const uint8_t* data, size_t size);
+
+// Decompress a complete stream (for gzip every member) to the file descriptor, writing each chunk of output directly
+// from the inflater's window so memory use is constant. Returns the size of the output. Throws std::runtime_error if
+// the stream is invalid or truncated (after writing the output before the error).
+uint64_t decompress_to_fd(stream_format format, const uint8_t* begin, const uint8_t* end, int fd);
+
+} // namespace deflate
+
+#endif
@@ -0,0 +1,237 @@
+#include "gzip_index.h"
+#include "deflate.h"
+#include "deflate_error.h"
+#include "parallel_inflate.h"
+#include "block_decoder.h"
+#include "crc.h"
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace deflate {
+
+// Inflate the gzip file [begin, end) from the block at input_bit, which window precedes in its member, to the end
+// of the file. The handler gets the new output through output(data, size), stopping early if that returns false,
+// each block boundary through boundary(bit, history) where history ends with (at least 32 KiB of) the member's
+// output so far, and the trailer of each member through member_end(trailer).
+template<typename Handler>
+void inflate_indexed(const uint8_t* begin, const uint8_t* end, uint64_t input_bit, const std::vector<uint8_t>& window, Handler& handler)
+{
+    output_buffer history{4 * max_distance};
+    if (!window.empty()) {
+        memcpy(history.end(), window.data(), window.size());
+        history.commit(history.end() + window.size());
+    }
+    auto member = begin + input_bit / 8;
+    bit_stream bs{member, end};
+    if (input_bit % 8) {
+        bs.get_bits(static_cast<int>(input_bit % 8));
+    }
+    block_decoder decoder;
+    for (;;) {
+        handler.boundary(8 * static_cast<uint64_t>(member - begin) + bs.bit_position(), history);
+        block_decoder::status st;
+        do {
+            if (history.avail() < max_match_length) {
+                history.slide(max_distance);
+            }
+            const auto from = history.used();
+            st = decoder.decode_block(bs, history);
+            if (!handler.output(history.data() + from, history.used() - from)) {
+                return;
+            }
+        } while (st == block_decoder::status::need_output);
+        if (st == block_decoder::status::need_input) {
+            throw_deflate_error(error_code::truncated);
+        }
+        if (!decoder.done()) {
+            continue;
+        }
+
+        bs.remove_padding();
+        bs.align_to_byte();
+        const auto trailer = bs.position() - bs.available_bits() / 8;
+        if (end - trailer < 8) {
+            throw_deflate_error(error_code::truncated);
+        }
+        handler.member_end(trailer);
+        if (trailer + 8 == end) {
+            return;
+        }
+        member = skip_gzip_header(trailer + 8, end);
+        if (!member) {
+            throw_deflate_error(error_code::truncated);
+        }
+        bs      = bit_stream{member, end};
+        decoder = block_decoder{};
+        history.slide(0);
+    }
+}
+
+struct index_builder {
+    std::vector<gzip_index::point>& points;
+    uint64_t span;
+    uint64_t offset      = 0;
+    uint32_t crc         = 0;
+    uint32_t member_size = 0;
+
+    bool output(const uint8_t* data, int size) {
+        crc          = update_crc32(crc, data, data + size);
+        offset      += size;
+        member_size += size;
+        return true;
+    }
+
+    void boundary(uint64_t bit, const output_buffer& history) {
+        if (points.empty() || offset - points.back().output_offset >= span) {
+            const auto window_end = history.data() + history.used();
+            points.push_back({offset, bit, std::vector<uint8_t>(window_end - std::min<ptrdiff_t>(history.used(), max_distance), window_end)});
+        }
+    }
+
+    void member_end(const uint8_t* trailer) {
+        if (load_le32_unaligned(trailer) != crc) {
+            throw_deflate_error(error_code::crc32_mismatch);
+        }
+        if (load_le32_unaligned(trailer + 4) != member_size) {
+            throw_deflate_error(error_code::isize_mismatch);
+        }
+        crc         = 0;
+        member_size = 0;
+    }
+};
+
+struct index_extractor {
+    uint64_t pos;    // Offset of the next output
+    uint64_t offset; // Start of the wanted range
+    uint8_t* out;
+    size_t   size;
+    size_t   copied = 0;
+
+    bool output(const uint8_t* data, int n) {
+        const auto data_end = pos + n;
+        const auto from     = std::max(pos, offset + copied);
+        const auto to       = std::min(data_end, offset + size);
+        if (from < to) {
+            memcpy(out + copied, data + (from - pos), static_cast<size_t>(to - from));
+            copied += static_cast<size_t>(to - from);
+        }
+        pos = data_end;
+        return copied < size;
+    }
+
+    void boundary(uint64_t, const output_buffer&) {
+    }
+
+    void member_end(const uint8_t*) {
+    }
+};
+
+gzip_index::gzip_index(const uint8_t* begin, const uint8_t* end, uint64_t span)
+{
+    const auto data = skip_gzip_header(begin, end);
+    if (!data) {
+        throw_deflate_error(error_code::truncated);
+    }
+    index_builder builder{points_, span};
+    inflate_indexed(begin, end, 8 * static_cast<uint64_t>(data - begin), {}, builder);
+    uncompressed_size_ = builder.offset;
+}
+
+size_t gzip_index::extract(const uint8_t* begin, const uint8_t* end, uint64_t offset, uint8_t* out, size_t size) const
+{
+    if (!size || offset >= uncompressed_size_) {
+        return 0;
+    }
+    auto it = std::upper_bound(points_.begin(), points_.end(), offset, [](uint64_t o, const point& p) { return o < p.output_offset; });
+    assert(it != points_.begin());
+    const auto& p = *--it;
+    if (p.input_bit / 8 >= static_cast<uint64_t>(end - begin)) {
+        throw std::runtime_error("gzip index doesn't match the input");
+    }
+    index_extractor extractor{p.output_offset, offset, out, size};
+    inflate_indexed(begin, end, p.input_bit, p.window, extractor);
+    return extractor.copied;
+}
+
+// Serialized format (integers little endian), the windows are raw deflate streams:
+//   "GZIX" uncompressed_size:8 num_points:4 { output_offset:8 input_bit:8 window_size:2 compressed_size:4 window }*
+constexpr uint8_t index_magic[4] = { 'G', 'Z', 'I', 'X' };
+
+void put_index_le(std::vector<uint8_t>& out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+uint64_t get_index_le(const uint8_t*& p, const uint8_t* end, int bytes)
+{
+    if (end - p < bytes) {
+        throw std::runtime_error("Invalid gzip index");
+    }
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value |= static_cast<uint64_t>(*p++) << (8 * i);
+    }
+    return value;
+}
+
+std::vector<uint8_t> gzip_index::serialize() const
+{
+    std::vector<uint8_t> out(index_magic, index_magic + sizeof(index_magic));
+    put_index_le(out, uncompressed_size_, 8);
+    put_index_le(out, points_.size(), 4);
+    for (const auto& p : points_) {
+        put_index_le(out, p.output_offset, 8);
+        put_index_le(out, p.input_bit, 8);
+        const auto window = compress(stream_format::raw, p.window.data(), p.window.data() + p.window.size());
+        put_index_le(out, p.window.size(), 2);
+        put_index_le(out, window.size(), 4);
+        out.insert(out.end(), window.begin(), window.end());
+    }
+    return out;
+}
+
+gzip_index gzip_index::deserialize(const uint8_t* begin, const uint8_t* end)
+{
+    auto invalid = [] { throw std::runtime_error("Invalid gzip index"); };
+    if (end - begin < static_cast<ptrdiff_t>(sizeof(index_magic)) || memcmp(begin, index_magic, sizeof(index_magic))) {
+        invalid();
+    }
+    auto p = begin + sizeof(index_magic);
+    gzip_index index;
+    index.uncompressed_size_ = get_index_le(p, end, 8);
+    const auto num_points    = get_index_le(p, end, 4);
+    for (uint64_t i = 0; i < num_points; ++i) {
+        point pt;
+        pt.output_offset = get_index_le(p, end, 8);
+        pt.input_bit     = get_index_le(p, end, 8);
+        const auto window_size     = get_index_le(p, end, 2);
+        const auto compressed_size = get_index_le(p, end, 4);
+        if (window_size > max_distance || static_cast<uint64_t>(end - p) < compressed_size) {
+            invalid();
+        }
+        // Checkpoints are in order, the first at the start of the output
+        if (i ? pt.output_offset < index.points_.back().output_offset : pt.output_offset != 0) {
+            invalid();
+        }
+        pt.window.resize(window_size);
+        try {
+            if (decompress(stream_format::raw, p, p + compressed_size, pt.window.data(), pt.window.data() + window_size) != window_size) {
+                invalid();
+            }
+        } catch (const deflate_error&) {
+            invalid();
+        }
+        p += compressed_size;
+        index.points_.push_back(std::move(pt));
+    }
+    if (p != end || (index.uncompressed_size_ && index.points_.empty())) {
+        invalid();
+    }
+    return index;
+}
+
+} // namespace deflate
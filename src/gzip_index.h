@@ -0,0 +1,57 @@
+#ifndef DEFLATE_GZIP_INDEX_H
+#define DEFLATE_GZIP_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace deflate {
+
+// Checkpoints for random access into a gzip file (as in zlib's examples/zran.c).
+//
+// Building the index inflates the whole file once, recording the input position and the preceding 32 KiB of output
+// at the first block boundary after each span bytes of output. Reading a range then only inflates from the last
+// checkpoint before it.
+class gzip_index {
+public:
+    static constexpr uint64_t default_span = 1 << 20;
+
+    struct point {
+        uint64_t             output_offset; // Uncompressed position in the file
+        uint64_t             input_bit;     // Bit offset in the compressed file of the block starting there
+        std::vector<uint8_t> window;        // Output of the member before output_offset (at most 32 KiB)
+    };
+
+    explicit gzip_index() {
+    }
+
+    // Index the complete gzip file [begin, end). Throws std::runtime_error if it's invalid or truncated.
+    explicit gzip_index(const uint8_t* begin, const uint8_t* end, uint64_t span = default_span);
+
+    uint64_t uncompressed_size() const {
+        return uncompressed_size_;
+    }
+
+    const std::vector<point>& points() const {
+        return points_;
+    }
+
+    // Copy up to size bytes of output from offset on to out, inflating the gzip file [begin, end) the index was built
+    // for from the last checkpoint before offset. Returns the number of bytes copied (less than size only at the end
+    // of the output). Throws std::runtime_error if the input is invalid.
+    size_t extract(const uint8_t* begin, const uint8_t* end, uint64_t offset, uint8_t* out, size_t size) const;
+
+    // Compact binary representation (with the windows deflated) for storing the index next to the file
+    std::vector<uint8_t> serialize() const;
+
+    // Throws std::runtime_error if [begin, end) isn't a serialized index
+    static gzip_index deserialize(const uint8_t* begin, const uint8_t* end);
+
+private:
+    uint64_t           uncompressed_size_ = 0;
+    std::vector<point> points_;
+};
+
+} // namespace deflate
+
+#endif
@@ -19,6 +19,16 @@ struct huffman_code {
 inline bool operator==(const huffman_code& l, const huffman_code& r) { return l.len == r.len && l.value == r.value; }
 inline bool operator!=(const huffman_code& l, const huffman_code& r) { return !(l == r); }
 
+// Huffman codes are packed starting with their most significant bit, so they're read and written bit reversed
+constexpr int reversed_code(int code, int len)
+{
+    int r = 0;
+    for (int i = 0; i < len; ++i) {
+        r = (r << 1) | ((code >> i) & 1);
+    }
+    return r;
+}
+
 } // namespace deflate
 
 #endif
\ No newline at end of file
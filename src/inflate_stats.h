@@ -0,0 +1,89 @@
+#ifndef DEFLATE_INFLATE_STATS_H
+#define DEFLATE_INFLATE_STATS_H
+
+#include "output_buffer.h"
+
+#include <stdint.h>
+
+#ifdef DEFLATE_STATS
+#include <chrono>
+#endif
+
+namespace deflate {
+
+// Counters of the work done while inflating, to see which paths matter for some data. They're only collected when
+// compiled with DEFLATE_STATS defined (the DEFLATE_STATS CMake option), otherwise they stay zero and cost nothing.
+struct inflate_stats {
+    uint64_t stored_blocks        = 0;
+    uint64_t fixed_blocks         = 0;
+    uint64_t dynamic_blocks       = 0;
+    uint64_t stored_bytes         = 0;
+    uint64_t literals             = 0;
+    uint64_t matches              = 0;
+    uint64_t fast_path_symbols    = 0; // Literals, matches and block ends decoded by the unchecked fast loop
+    uint64_t slow_path_symbols    = 0; // Those decoded near the end of the input or output
+    uint64_t subtable_lookups     = 0; // Codes longer than the first level of a decode_table
+    uint64_t output_enlargements  = 0; // output_buffer::enlarge() calls
+    uint64_t decode_ns            = 0; // Time in block_decoder::decode(), including:
+    uint64_t dynamic_header_ns    = 0; // Time reading dynamic block code lengths and building their tables
+
+    uint64_t length_histogram[max_match_length + 1] = {}; // Matches by length
+    uint64_t distance_histogram[16]                 = {}; // Matches by floor(log2(distance))
+};
+
+#ifdef DEFLATE_STATS
+constexpr bool inflate_stats_enabled = true;
+#else
+constexpr bool inflate_stats_enabled = false;
+#endif
+
+// Statistics of the calling thread, accumulated until the caller resets them (thread_inflate_stats() = {}). Work done
+// by worker threads, e.g. of decompress_parallel(), is counted in those threads.
+inline inflate_stats& thread_inflate_stats()
+{
+    thread_local inflate_stats stats;
+    return stats;
+}
+
+#ifdef DEFLATE_STATS
+#define DEFLATE_STAT(statement) do { statement; } while (false)
+
+// Adds the time until the end of the scope to a counter of thread_inflate_stats()
+#define DEFLATE_STAT_TIMER(counter) inflate_stats_timer deflate_stats_timer{thread_inflate_stats().counter}
+
+class inflate_stats_timer {
+public:
+    explicit inflate_stats_timer(uint64_t& ns) : ns_(ns), start_(std::chrono::steady_clock::now()) {
+    }
+
+    ~inflate_stats_timer() {
+        ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    inflate_stats_timer(const inflate_stats_timer&) = delete;
+    inflate_stats_timer& operator=(const inflate_stats_timer&) = delete;
+
+private:
+    uint64_t&                             ns_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+inline void count_match(int length, int distance)
+{
+    auto& stats = thread_inflate_stats();
+    ++stats.matches;
+    ++stats.length_histogram[length];
+    int bucket = 0;
+    while (distance >>= 1) {
+        ++bucket;
+    }
+    ++stats.distance_histogram[bucket];
+}
+#else
+#define DEFLATE_STAT(statement) do { } while (false)
+#define DEFLATE_STAT_TIMER(counter) do { } while (false)
+#endif
+
+} // namespace deflate
+
+#endif
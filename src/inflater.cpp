@@ -0,0 +1,297 @@
+#include "inflater.h"
+#include "crc.h"
+#include "adler32.h"
+#include "deflate_error.h"
+#include <stddef.h>
+#include <algorithm>
+
+namespace deflate {
+
+enum gzip_flag { gzip_ftext = 1, gzip_fhcrc = 2, gzip_fextra = 4, gzip_fname = 8, gzip_fcomment = 16, gzip_reserved = 0xe0 };
+
+// Read an n (at most 4) byte integer from a byte aligned bit_stream. Returns false with the remaining input moved to
+// the bit buffer if the input runs out first.
+bool read_framing_bytes(bit_stream& bs, int n, bool big_endian, uint32_t& value)
+{
+    assert(n > 0 && n <= 4 && bs.available_bits() % 8 == 0);
+    const auto saved = bs;
+    bs.ensure_bits(8 * n);
+    uint32_t v = 0;
+    for (int i = 0; i < n; ++i) {
+        const auto b = bs.get_bits(8);
+        v = big_endian ? (v << 8) | b : v | (b << (8 * i));
+    }
+    if (bs.overrun()) {
+        bs = saved;
+        bs.buffer_remaining_input();
+        return false;
+    }
+    value = v;
+    return true;
+}
+
+inflater::inflater(checksum_type type, allocator& alloc)
+    : format_(stream_format::raw)
+    , window_(2 * window_size, alloc)
+    , checksum_type_(type)
+{
+    reset();
+}
+
+inflater::inflater(stream_format format, allocator& alloc)
+    : format_(format)
+    , window_(2 * window_size, alloc)
+    , checksum_type_(format == stream_format::gzip ? checksum_type::crc32 : format == stream_format::zlib ? checksum_type::adler32 : checksum_type::none)
+{
+    reset();
+}
+
+void inflater::reset()
+{
+    state_          = format_ == stream_format::gzip ? state::gzip_header : format_ == stream_format::zlib ? state::zlib_header : state::body;
+    gzip_flags_     = 0;
+    skip_           = 0;
+    member_size_    = 0;
+    decoder_.reset();
+    window_.slide(0);
+    flushed_        = 0;
+    bits_           = 0;
+    avail_          = 0;
+    checksum_       = checksum_type_ == checksum_type::adler32 ? 1 : 0;
+    has_dictionary_ = false;
+    dictionary_id_  = 0;
+}
+
+void inflater::set_dictionary(const uint8_t* begin, const uint8_t* end)
+{
+    assert(format_ != stream_format::gzip && flushed_ == 0 && !bits_ && !avail_);
+    has_dictionary_ = true;
+    dictionary_id_  = update_adler32(1, begin, end);
+    const auto size = static_cast<int>(std::min<ptrdiff_t>(end - begin, window_size));
+    if (size) {
+        memcpy(window_.end(), end - size, size);
+    }
+    window_.commit(window_.end() + size);
+    flushed_ = size; // Not part of the output
+}
+
+inflater::status inflater::inflate(const uint8_t*& in, const uint8_t* in_end, uint8_t*& out, uint8_t* out_end)
+{
+    return run(in, in_end, [&] {
+        flush(out, out_end);
+        return flushed_ != window_.used();
+    });
+}
+
+inflater::status inflater::inflate(const uint8_t*& in, const uint8_t* in_end, const uint8_t*& data, size_t& size)
+{
+    size = 0;
+    return run(in, in_end, [&] {
+        if (flushed_ == window_.used()) {
+            return false;
+        }
+        data = window_.data() + flushed_;
+        size = window_.used() - flushed_;
+        output_flushed(data, static_cast<int>(size));
+        return true;
+    });
+}
+
+inflater::feed_result inflater::feed(const uint8_t* in, size_t in_size, uint8_t* out, size_t out_size)
+{
+    const uint8_t* in_pos  = in;
+    uint8_t*       out_pos = out;
+    const auto st = inflate(in_pos, in + in_size, out_pos, out + out_size);
+    return feed_result{static_cast<size_t>(in_pos - in), static_cast<size_t>(out_pos - out), st};
+}
+
+template<typename Flush>
+inflater::status inflater::run(const uint8_t*& in, const uint8_t* in_end, Flush flush)
+{
+    bit_stream bs{in, in_end, bits_, avail_};
+    status st;
+    for (;;) {
+        if (flush()) {
+            st = status::need_output;
+            break;
+        }
+        if (state_ == state::body) {
+            if (window_.avail() < max_match_length) {
+                // Everything has been output, only the history needed for back-references has to be kept
+                window_.slide(window_size);
+                flushed_ = window_.used();
+            }
+            st = decoder_.decode(bs, window_);
+            if (st == status::need_input) {
+                break;
+            } else if (st == status::done) {
+                // The trailer starts at the next byte boundary, and is checked once all output is flushed
+                bs.align_to_byte();
+                state_ = format_ == stream_format::gzip ? state::gzip_crc : format_ == stream_format::zlib ? state::zlib_adler : state::done;
+            }
+        } else if (state_ == state::done) {
+            bs.remove_padding();
+            if (format_ == stream_format::gzip && (bs.available_bits() || bs.remaining_bytes())) {
+                start_member();
+                continue;
+            }
+            st = status::done;
+            break;
+        } else if (!read_framing(bs)) {
+            st = status::need_input;
+            break;
+        }
+    }
+
+    bs.remove_padding();
+    if (st == status::done && bs.available_bits() / 8 <= bs.position() - in) {
+        // Give back input read ahead past the end of the stream
+        in     = bs.position() - bs.available_bits() / 8;
+        bits_  = 0;
+        avail_ = 0;
+        return st;
+    }
+    in     = bs.position();
+    bits_  = bs.buffered_bits();
+    avail_ = bs.available_bits();
+    return st;
+}
+
+void inflater::start_member()
+{
+    assert(format_ == stream_format::gzip && flushed_ == window_.used());
+    decoder_.reset();
+    window_.slide(0); // Members are independent
+    flushed_     = 0;
+    member_size_ = 0;
+    checksum_    = 0;
+    state_       = state::gzip_header;
+}
+
+// Parse the header or trailer field for the current state, returns false if more input is needed
+bool inflater::read_framing(bit_stream& bs)
+{
+    uint32_t v;
+    switch (state_) {
+    case state::gzip_header:
+        // +---+---+---+---+
+        // |ID1|ID2|CM |FLG|
+        // +---+---+---+---+
+        if (!read_framing_bytes(bs, 4, false, v)) return false;
+        if ((v & 0xffffff) != 0x088b1f || (v >> 24) & gzip_reserved) {
+            throw_deflate_error(error_code::invalid_gzip_header);
+        }
+        gzip_flags_ = v >> 24;
+        state_ = state::gzip_mtime;
+        break;
+    case state::gzip_mtime:
+        if (!read_framing_bytes(bs, 4, false, v)) return false;
+        state_ = state::gzip_xfl_os;
+        break;
+    case state::gzip_xfl_os:
+        if (!read_framing_bytes(bs, 2, false, v)) return false;
+        state_ = state::gzip_xlen;
+        break;
+    case state::gzip_xlen:
+        if (gzip_flags_ & gzip_fextra) {
+            if (!read_framing_bytes(bs, 2, false, v)) return false;
+            skip_ = static_cast<int>(v);
+        }
+        state_ = state::gzip_extra;
+        break;
+    case state::gzip_extra:
+        for (; skip_; --skip_) {
+            if (!read_framing_bytes(bs, 1, false, v)) return false;
+        }
+        state_ = state::gzip_name;
+        break;
+    case state::gzip_name:
+    case state::gzip_comment:
+        // Zero-terminated strings
+        if (gzip_flags_ & (state_ == state::gzip_name ? gzip_fname : gzip_fcomment)) {
+            do {
+                if (!read_framing_bytes(bs, 1, false, v)) return false;
+            } while (v);
+        }
+        state_ = state_ == state::gzip_name ? state::gzip_comment : state::gzip_hcrc;
+        break;
+    case state::gzip_hcrc:
+        // The header CRC-16 isn't checked
+        if (gzip_flags_ & gzip_fhcrc) {
+            if (!read_framing_bytes(bs, 2, false, v)) return false;
+        }
+        state_ = state::body;
+        break;
+    case state::gzip_crc:
+        if (!read_framing_bytes(bs, 4, false, v)) return false;
+        if (v != checksum_) {
+            throw_deflate_error(error_code::crc32_mismatch);
+        }
+        state_ = state::gzip_isize;
+        break;
+    case state::gzip_isize:
+        if (!read_framing_bytes(bs, 4, false, v)) return false;
+        if (v != member_size_) {
+            throw_deflate_error(error_code::isize_mismatch);
+        }
+        state_ = state::done;
+        break;
+    case state::zlib_header: {
+        // +---+---+
+        // |CMF|FLG|
+        // +---+---+
+        if (!read_framing_bytes(bs, 2, true, v)) return false;
+        const auto cm    = (v >> 8) & 15;
+        const auto cinfo = v >> 12;
+        if (cm != 8 || cinfo > 7 || v % 31) {
+            throw_deflate_error(error_code::invalid_zlib_header);
+        }
+        state_ = v & 0x20 ? state::zlib_dictid : state::body;
+        break;
+    }
+    case state::zlib_dictid:
+        if (!read_framing_bytes(bs, 4, true, v)) return false;
+        if (!has_dictionary_) {
+            throw_deflate_error(error_code::dictionary_required);
+        }
+        if (v != dictionary_id_) {
+            throw_deflate_error(error_code::dictionary_mismatch);
+        }
+        state_ = state::body;
+        break;
+    case state::zlib_adler:
+        if (!read_framing_bytes(bs, 4, true, v)) return false;
+        if (v != checksum_) {
+            throw_deflate_error(error_code::adler32_mismatch);
+        }
+        state_ = state::done;
+        break;
+    default:
+        assert(false);
+    }
+    return true;
+}
+
+void inflater::flush(uint8_t*& out, uint8_t* out_end)
+{
+    const auto n = static_cast<int>(std::min<ptrdiff_t>(out_end - out, window_.used() - flushed_));
+    if (n > 0) {
+        const auto chunk = window_.data() + flushed_;
+        memcpy(out, chunk, n);
+        out += n;
+        output_flushed(chunk, n);
+    }
+}
+
+void inflater::output_flushed(const uint8_t* chunk, int n)
+{
+    if (checksum_type_ == checksum_type::crc32) {
+        checksum_ = update_crc32(checksum_, chunk, chunk + n);
+    } else if (checksum_type_ == checksum_type::adler32) {
+        checksum_ = update_adler32(checksum_, chunk, chunk + n);
+    }
+    flushed_     += n;
+    member_size_ += n;
+}
+
+} // namespace deflate
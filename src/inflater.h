@@ -0,0 +1,146 @@
+#ifndef DEFLATE_INFLATER_H
+#define DEFLATE_INFLATER_H
+
+#include "block_decoder.h"
+
+namespace deflate {
+
+// Framing around the deflate data
+enum class stream_format {
+    raw,  // Deflate data only (RFC 1951)
+    zlib, // zlib header and Adler-32 trailer (RFC 1950)
+    gzip, // One or more gzip members, each with header, CRC-32 and ISIZE trailer (RFC 1952)
+};
+
+// Streaming deflate decompressor with bounded memory use.
+//
+// Input can be supplied in arbitrarily sized chunks (split at any byte) and output is produced into caller supplied
+// buffers of any size. Decoding happens in an internal buffer holding the 32 KiB window of history required for
+// back-references plus the same amount of newly decoded data waiting to be handed out.
+//
+// For zlib and gzip streams the header is parsed and the trailer checked against the checksum computed while the
+// output is handed out.
+//
+// An inflater can be reset() and reused for any number of streams, after construction it allocates nothing.
+class inflater {
+public:
+    using status = block_decoder::status;
+
+    // Checksum to maintain over the output, updated as each chunk is handed out while it's still in cache
+    enum class checksum_type { none, crc32, adler32 };
+
+    // Raw deflate stream, the window is allocated from alloc
+    explicit inflater(checksum_type type = checksum_type::none, allocator& alloc = default_allocator());
+
+    // zlib streams use Adler-32 and gzip streams CRC-32
+    explicit inflater(stream_format format, allocator& alloc = default_allocator());
+
+    // Start over with a new stream of the same format, forgetting any dictionary
+    void reset();
+
+    stream_format format() const {
+        return format_;
+    }
+
+    // Use [begin, end) as the preset dictionary: the stream starts with its last 32 KiB as history. Must be called
+    // before inflate() and not for gzip streams. A zlib stream must name the dictionary (by its Adler-32) if its
+    // FDICT flag is set.
+    void set_dictionary(const uint8_t* begin, const uint8_t* end);
+
+    // Decompress from [in, in_end) to [out, out_end), advancing in and out past the consumed input and the produced
+    // output. Returns status::need_input when all input has been consumed, status::need_output when the output is
+    // full and status::done when the stream has ended and all output has been produced. Unless the stream is done,
+    // all input is consumed or the output is full.
+    // When done, in is left just past the end of the stream if the bytes read ahead came from this call's input.
+    // A gzip stream is done after a member when no more input follows; calling inflate() with more input continues
+    // with the next member.
+    // Throws deflate_error on invalid input.
+    status inflate(const uint8_t*& in, const uint8_t* in_end, uint8_t*& out, uint8_t* out_end);
+
+    // Like the above, but hands out the output in place instead of copying it: status::need_output means
+    // [data, data + size) is the next chunk of output, valid until the next call. For any other status size is 0.
+    status inflate(const uint8_t*& in, const uint8_t* in_end, const uint8_t*& data, size_t& size);
+
+    // What a feed() call did
+    struct feed_result {
+        size_t consumed; // Bytes of input used
+        size_t produced; // Bytes of output
+        status st;
+    };
+
+    // Non-blocking decoding of input as it arrives (e.g. from a socket in an event loop): like inflate() but with
+    // sizes instead of advancing pointers, so the caller can keep the rest of the input and output for the next call.
+    feed_result feed(const uint8_t* in, size_t in_size, uint8_t* out, size_t out_size);
+
+    // Decode all of [in, in + in_size), passing each chunk of output to sink(const uint8_t* data, size_t size) as
+    // soon as it's decoded, without copying it. status::need_input when all input is used, status::done (consumed
+    // telling where the stream ended) when the stream has ended with all output passed on.
+    template<typename Sink>
+    feed_result feed(const uint8_t* in, size_t in_size, Sink&& sink);
+
+    bool done() const {
+        return state_ == state::done && flushed_ == window_.used();
+    }
+
+    // CRC-32 or Adler-32 of all output produced so far (for gzip: of the current member)
+    uint32_t checksum() const {
+        assert(checksum_type_ != checksum_type::none);
+        return checksum_;
+    }
+
+private:
+    static constexpr int window_size = max_distance;
+
+    enum class state {
+        gzip_header, gzip_mtime, gzip_xfl_os, gzip_xlen, gzip_extra, gzip_name, gzip_comment, gzip_hcrc,
+        zlib_header, zlib_dictid,
+        body,
+        gzip_crc, gzip_isize,
+        zlib_adler,
+        done,
+    };
+
+    stream_format format_;
+    state         state_;
+    int           gzip_flags_ = 0;
+    int           skip_       = 0;  // FEXTRA bytes left to skip
+    uint32_t      member_size_ = 0; // Output size modulo 2^32 of the current gzip member
+    block_decoder decoder_;
+    output_buffer window_;
+    int           flushed_ = 0; // Decoded bytes in window_ before this position have been output
+    uint64_t      bits_    = 0; // Input bits consumed, but not yet used by decoder_
+    int           avail_   = 0;
+    checksum_type checksum_type_;
+    uint32_t      checksum_;
+    bool          has_dictionary_ = false;
+    uint32_t      dictionary_id_  = 0; // Adler-32 of the preset dictionary
+
+    void start_member();
+    bool read_framing(bit_stream& bs);
+    template<typename Flush>
+    status run(const uint8_t*& in, const uint8_t* in_end, Flush flush);
+    void flush(uint8_t*& out, uint8_t* out_end);
+    void output_flushed(const uint8_t* chunk, int n);
+};
+
+template<typename Sink>
+inflater::feed_result inflater::feed(const uint8_t* in, size_t in_size, Sink&& sink)
+{
+    const uint8_t* pos = in;
+    feed_result result{0, 0, status::need_output};
+    while (result.st == status::need_output) {
+        const uint8_t* data;
+        size_t         size;
+        result.st = inflate(pos, in + in_size, data, size);
+        if (size) {
+            sink(data, size);
+            result.produced += size;
+        }
+    }
+    result.consumed = pos - in;
+    return result;
+}
+
+} // namespace deflate
+
+#endif
@@ -0,0 +1,41 @@
+#include "output_buffer.h"
+#include "inflate_stats.h"
+#include <new>
+
+namespace deflate {
+
+output_buffer::output_buffer(ptrdiff_t capacity, allocator& alloc) : buffer_(nullptr, buffer_deleter{&alloc, 0}), capacity_(capacity)
+{
+    assert(capacity > 0);
+    const size_t size = capacity + copy_match_slack;
+    buffer_.reset(static_cast<uint8_t*>(alloc.allocate(size)));
+    if (!buffer_) throw std::bad_alloc{};
+    buffer_.get_deleter().size = size;
+}
+
+void output_buffer::enlarge()
+{
+    assert(slack_); // Caller supplied buffers can't be enlarged
+    DEFLATE_STAT(++thread_inflate_stats().output_enlargements);
+    const auto new_capacity = capacity_ ? 2 * capacity_ : 32768;
+    const size_t size = new_capacity + copy_match_slack;
+    auto& alloc = *buffer_.get_deleter().alloc;
+    buf_ptr new_buffer(static_cast<uint8_t*>(alloc.allocate(size)), buffer_deleter{&alloc, size});
+    if (!new_buffer) throw std::bad_alloc{};
+    if (used_) {
+        memcpy(new_buffer.get(), buffer_.get(), used_);
+    }
+    buffer_   = std::move(new_buffer);
+    capacity_ = new_capacity;
+}
+
+void output_buffer::slide(ptrdiff_t keep)
+{
+    if (keep >= used_) {
+        return;
+    }
+    memmove(buffer_.get(), buffer_.get() + used_ - keep, keep);
+    used_ = keep;
+}
+
+} // namespace deflate
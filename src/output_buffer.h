@@ -0,0 +1,161 @@
+#ifndef DEFLATE_OUTPUT_BUFFER_H
+#define DEFLATE_OUTPUT_BUFFER_H
+
+#include "allocator.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace deflate {
+
+constexpr int max_match_length = 258;
+constexpr int max_distance     = 32768;
+
+// Number of bytes copy_match may write past the end of the match
+constexpr int copy_match_slack = 16;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+using chunk16 = __m128i;
+inline chunk16 load_chunk16(const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline void store_chunk16(uint8_t* p, chunk16 c) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), c); }
+#elif defined(__ARM_NEON)
+using chunk16 = uint8x16_t;
+inline chunk16 load_chunk16(const uint8_t* p) { return vld1q_u8(p); }
+inline void store_chunk16(uint8_t* p, chunk16 c) { vst1q_u8(p, c); }
+#else
+struct chunk16 { uint64_t lo, hi; };
+inline chunk16 load_chunk16(const uint8_t* p) { chunk16 c; memcpy(&c, p, sizeof(c)); return c; }
+inline void store_chunk16(uint8_t* p, chunk16 c) { memcpy(p, &c, sizeof(c)); }
+#endif
+
+// Copy length bytes starting distance bytes before out to out, possibly overwriting up to copy_match_slack bytes
+// after them
+inline void copy_match(uint8_t* out, int distance, int length)
+{
+    assert(distance > 0 && distance <= max_distance);
+    assert(length >= 3 && length <= max_match_length);
+    const uint8_t* in  = out - distance;
+    uint8_t* const end = out + length;
+    if (distance >= 16) {
+        // Each chunk only reads bytes from before the chunk
+        do {
+            store_chunk16(out, load_chunk16(in));
+            out += 16;
+            in  += 16;
+        } while (out < end);
+    } else {
+        // Repeat the distance byte pattern to fill a chunk and write it out advancing by the largest multiple of
+        // distance that fits, so every chunk starts at the same point of the pattern
+        uint8_t pattern[16];
+        for (int i = 0; i < 16; ++i) {
+            pattern[i] = in[i % distance];
+        }
+        const auto chunk   = load_chunk16(pattern);
+        const int  advance = 16 - 16 % distance;
+        do {
+            store_chunk16(out, chunk);
+            out += advance;
+        } while (out < end);
+    }
+}
+
+// Buffer for decoded data. copy_match_slack bytes are allocated beyond capacity() so matches can be copied in whole
+// chunks.
+class output_buffer {
+public:
+    explicit output_buffer(allocator& alloc = default_allocator()) : buffer_(nullptr, buffer_deleter{&alloc, 0}) {
+    }
+
+    explicit output_buffer(ptrdiff_t capacity, allocator& alloc = default_allocator());
+
+    // Decode into the caller's [begin, end), which can't be enlarged. Without slack after it, matches ending within
+    // copy_match_slack bytes of the end are copied byte by byte.
+    explicit output_buffer(uint8_t* begin, uint8_t* end) : buffer_(begin, buffer_deleter{nullptr, 0}), capacity_(end - begin), slack_(0) {
+    }
+
+    void put(uint8_t c) {
+        assert(used() < capacity());
+        buffer_[used_++] = c;
+    }
+
+    void copy_match(int distance, int length) {
+        assert(distance <= used_ && length <= avail());
+        uint8_t* const out = buffer_.get() + used_;
+        if (length <= chunk_avail()) {
+            deflate::copy_match(out, distance, length);
+        } else {
+            for (int i = 0; i < length; ++i) {
+                out[i] = out[i - distance];
+            }
+        }
+        used_ += length;
+    }
+
+    const uint8_t* data() const {
+        return buffer_.get();
+    }
+
+    // For writing up to avail() bytes directly, make them part of the output with commit()
+    uint8_t* end() {
+        return buffer_.get() + used_;
+    }
+
+    void commit(uint8_t* new_end) {
+        assert(new_end >= end() && new_end <= buffer_.get() + capacity_);
+        used_ = new_end - buffer_.get();
+    }
+
+    ptrdiff_t used() const {
+        return used_;
+    }
+
+    ptrdiff_t avail() const {
+        return capacity() - used();
+    }
+
+    ptrdiff_t capacity() const {
+        return capacity_;
+    }
+
+    // Room for matches copied in whole chunks (see deflate::copy_match)
+    ptrdiff_t chunk_avail() const {
+        return avail() - (copy_match_slack - slack_);
+    }
+
+    void enlarge();
+
+    // Discard all but the last keep bytes, moving them to the start of the buffer
+    void slide(ptrdiff_t keep);
+
+    std::vector<uint8_t> finish() {
+        return std::vector<uint8_t>{buffer_.get(), buffer_.get() + used_};
+    }
+
+private:
+    struct buffer_deleter {
+        allocator* alloc;
+        size_t     size;
+        void operator()(uint8_t* ptr) { if (alloc) alloc->deallocate(ptr, size); } // Not owned without alloc
+    };
+
+    using buf_ptr = std::unique_ptr<uint8_t[], buffer_deleter>;
+
+    buf_ptr   buffer_;
+    ptrdiff_t used_ = 0;
+    ptrdiff_t capacity_ = 0;
+    ptrdiff_t slack_ = copy_match_slack; // Bytes writable after capacity_
+};
+
+} // namespace deflate
+
+#endif
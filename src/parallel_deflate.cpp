@@ -0,0 +1,110 @@
+#include "parallel_deflate.h"
+#include "parallel_for.h"
+#include "crc.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+namespace deflate {
+
+constexpr int    bgzf_max_input   = 0xff00;
+constexpr size_t bgzf_max_member  = 0x10000;
+constexpr size_t bgzf_header_size = 18;
+
+struct deflate_chunk {
+    std::vector<uint8_t> output;
+    uint32_t             crc;
+};
+
+int compression_threads(int num_threads)
+{
+    return num_threads > 0 ? num_threads : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+// Append the outputs of the chunks to out, copying in parallel
+void join_chunks(std::vector<uint8_t>& out, const std::vector<deflate_chunk>& chunks, int num_threads)
+{
+    std::vector<size_t> offsets(chunks.size() + 1, out.size());
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        offsets[i + 1] = offsets[i] + chunks[i].output.size();
+    }
+    out.resize(offsets.back());
+    parallel_for(static_cast<int>(chunks.size()), num_threads, [&](int i) {
+        if (!chunks[i].output.empty()) {
+            memcpy(out.data() + offsets[i], chunks[i].output.data(), chunks[i].output.size());
+        }
+    });
+}
+
+std::vector<uint8_t> compress_parallel(const uint8_t* begin, const uint8_t* end, int level, int num_threads, int chunk_size)
+{
+    assert(chunk_size > 0);
+    num_threads = compression_threads(num_threads);
+    const auto input_size = end - begin;
+    const int  num_chunks = std::max(1, static_cast<int>((input_size + chunk_size - 1) / chunk_size));
+
+    std::vector<deflate_chunk> chunks(num_chunks);
+    parallel_for(num_chunks, num_threads, [&](int i) {
+        const auto chunk_begin = begin + static_cast<ptrdiff_t>(i) * chunk_size;
+        const auto chunk_end   = i + 1 == num_chunks ? end : chunk_begin + chunk_size;
+        // The deflater only uses the last 32 KiB of history
+        deflater{level}.compress(begin, chunk_begin, chunk_end, i + 1 == num_chunks, chunks[i].output);
+        chunks[i].crc = update_crc32(0, chunk_begin, chunk_end);
+    });
+
+    std::vector<uint8_t> output;
+    put_gzip_header(output, level);
+    join_chunks(output, chunks, num_threads);
+    uint32_t crc = 0;
+    for (int i = 0; i < num_chunks; ++i) {
+        const auto chunk_length = input_size - static_cast<ptrdiff_t>(i) * chunk_size;
+        crc = combine_crc32(crc, chunks[i].crc, static_cast<uint64_t>(std::min<ptrdiff_t>(chunk_length, chunk_size)));
+    }
+    put_gzip_trailer(output, crc, static_cast<uint32_t>(input_size));
+    return output;
+}
+
+std::vector<uint8_t> compress_bgzf(const uint8_t* begin, const uint8_t* end, int level, int num_threads)
+{
+    num_threads = compression_threads(num_threads);
+    const auto input_size = end - begin;
+    // The last member is the empty end of file marker
+    const int  num_members = static_cast<int>((input_size + bgzf_max_input - 1) / bgzf_max_input) + 1;
+
+    std::vector<deflate_chunk> members(num_members);
+    parallel_for(num_members, num_threads, [&](int i) {
+        const auto member_begin = begin + std::min<ptrdiff_t>(input_size, static_cast<ptrdiff_t>(i) * bgzf_max_input);
+        const auto member_end   = begin + std::min<ptrdiff_t>(input_size, static_cast<ptrdiff_t>(i + 1) * bgzf_max_input);
+        auto& out = members[i].output;
+        // Header with FEXTRA, XLEN 6 and the BC subfield holding the member size - 1
+        put_framing_bytes(out, 0x04088b1f, 4, false);
+        put_framing_bytes(out, 0, 4, false);
+        out.push_back(0);
+        out.push_back(255);
+        put_framing_bytes(out, 6, 2, false);
+        out.push_back('B');
+        out.push_back('C');
+        put_framing_bytes(out, 2, 2, false);
+        put_framing_bytes(out, 0, 2, false);
+        deflater{level}.compress(member_begin, member_begin, member_end, true, out);
+        if (out.size() + 8 > bgzf_max_member) {
+            // A single stored block keeps even incompressible input below the limit
+            out.resize(bgzf_header_size);
+            deflater{0}.compress(member_begin, member_begin, member_end, true, out);
+        }
+        put_gzip_trailer(out, update_crc32(0, member_begin, member_end), static_cast<uint32_t>(member_end - member_begin));
+        assert(out.size() <= bgzf_max_member);
+        const auto bsize = static_cast<uint32_t>(out.size() - 1);
+        out[16] = static_cast<uint8_t>(bsize);
+        out[17] = static_cast<uint8_t>(bsize >> 8);
+    });
+
+    std::vector<uint8_t> output;
+    join_chunks(output, members, num_threads);
+    return output;
+}
+
+} // namespace deflate
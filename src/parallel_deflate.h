@@ -0,0 +1,27 @@
+#ifndef DEFLATE_PARALLEL_DEFLATE_H
+#define DEFLATE_PARALLEL_DEFLATE_H
+
+#include "deflater.h"
+
+#include <stdint.h>
+#include <vector>
+
+namespace deflate {
+
+// Compress [begin, end) as a gzip file using num_threads threads (0 for one per core), like pigz.
+//
+// The input is split into chunks of chunk_size bytes that are compressed in parallel, each using the 32 KiB before it
+// as history so the ratio is close to compress()'s. Every chunk but the last ends with a sync flush, so the
+// compressed chunks can simply be concatenated, and the CRC-32 of the whole input is combined from theirs.
+std::vector<uint8_t> compress_parallel(const uint8_t* begin, const uint8_t* end, int level = default_compression_level, int num_threads = 0, int chunk_size = 128 << 10);
+
+// Compress [begin, end) in the BGZF format (the blocked gzip of SAMtools) using num_threads threads.
+//
+// The output is a series of gzip members, each compressing at most 65280 bytes independently and recording its
+// compressed size in a "BC" extra field, followed by an empty member marking the end. It's readable by any gzip
+// decoder and decompress_parallel() splits it at every member.
+std::vector<uint8_t> compress_bgzf(const uint8_t* begin, const uint8_t* end, int level = default_compression_level, int num_threads = 0);
+
+} // namespace deflate
+
+#endif
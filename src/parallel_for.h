@@ -0,0 +1,53 @@
+#ifndef DEFLATE_PARALLEL_FOR_H
+#define DEFLATE_PARALLEL_FOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace deflate {
+
+// Run f(0), ..., f(count-1) on up to num_threads threads (including the calling thread). If a call throws, no more
+// calls are started and the (first) exception is rethrown once the threads have finished.
+template<typename F>
+void parallel_for(int count, int num_threads, F f)
+{
+    std::atomic<int>   next{0};
+    std::mutex         error_mutex;
+    std::exception_ptr error;
+    auto worker = [&] {
+        try {
+            for (int i; (i = next++) < count;) {
+                f(i);
+            }
+        } catch (...) {
+            next = count;
+            std::lock_guard<std::mutex> lock{error_mutex};
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    try {
+        for (int t = 1; t < std::min(num_threads, count); ++t) {
+            threads.emplace_back(worker);
+        }
+    } catch (...) {
+        // Couldn't start a thread, the calling thread does the rest
+    }
+    worker();
+    for (auto& t : threads) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace deflate
+
+#endif
@@ -0,0 +1,318 @@
+#include "parallel_inflate.h"
+#include "deflate_error.h"
+#include "parallel_for.h"
+#include "block_decoder.h"
+#include "crc.h"
+
+#include <string.h>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+namespace deflate {
+
+uint32_t load_le32_unaligned(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+bool is_gzip_member_start(const uint8_t* p, const uint8_t* end)
+{
+    return end - p >= 4 && p[0] == 0x1f && p[1] == 0x8b && p[2] == 8 && !(p[3] & 0xe0);
+}
+
+bool follows_sync_flush(const uint8_t* p, const uint8_t* begin)
+{
+    return p - begin >= 4 && p[-4] == 0x00 && p[-3] == 0x00 && p[-2] == 0xff && p[-1] == 0xff;
+}
+
+const uint8_t* skip_gzip_header(const uint8_t* p, const uint8_t* end)
+{
+    enum { fhcrc = 2, fextra = 4, fname = 8, fcomment = 16 };
+    if (end - p < 10) {
+        return nullptr;
+    }
+    if (!is_gzip_member_start(p, end)) {
+        throw_deflate_error(error_code::invalid_gzip_header);
+    }
+    const auto flags = p[3];
+    p += 10;
+    if (flags & fextra) {
+        if (end - p < 2) {
+            return nullptr;
+        }
+        const int xlen = p[0] | (p[1] << 8);
+        if (end - p < 2 + xlen) {
+            return nullptr;
+        }
+        p += 2 + xlen;
+    }
+    for (const int string_flag : { fname, fcomment }) {
+        if (flags & string_flag) {
+            p = static_cast<const uint8_t*>(memchr(p, 0, end - p));
+            if (!p) {
+                return nullptr;
+            }
+            ++p;
+        }
+    }
+    if (flags & fhcrc) {
+        if (end - p < 2) {
+            return nullptr;
+        }
+        p += 2;
+    }
+    return p;
+}
+
+// Output of a chunk up to the end of a member or the end of the chunk
+struct inflate_chunk_part {
+    uint64_t size;
+    uint32_t crc;
+    bool     member_end;
+    uint32_t trailer_crc;
+    uint32_t trailer_isize;
+};
+
+struct inflate_chunk {
+    enum class state { header, body, trailer };
+
+    const uint8_t*     begin;
+    bool               member_start; // Starts with a gzip header, otherwise with a block following a sync flush
+    std::exception_ptr error;
+
+    // Input position (for state::body the input up to pos has been moved to the bit buffer)
+    state              st;
+    const uint8_t*     pos;
+    uint64_t           bits  = 0;
+    int                avail = 0;
+    block_decoder      decoder;
+
+    // Output of the current member. Each member gets a buffer of its own, so members can't reference earlier ones.
+    output_buffer              output;
+    std::vector<output_buffer> member_outputs; // Of the members that ended in the chunk
+
+    std::vector<inflate_chunk_part> parts;
+    ptrdiff_t          part_begin = 0; // Start of the output not yet in parts
+    ptrdiff_t          crc_end    = 0; // part_crc covers output from part_begin to here
+    uint32_t           part_crc   = 0;
+};
+
+void checksum_chunk_output(inflate_chunk& c)
+{
+    c.part_crc = update_crc32(c.part_crc, c.output.data() + c.crc_end, c.output.end());
+    c.crc_end  = c.output.used();
+}
+
+void end_chunk_part(inflate_chunk& c, bool member_end, uint32_t trailer_crc, uint32_t trailer_isize)
+{
+    checksum_chunk_output(c);
+    c.parts.push_back({static_cast<uint64_t>(c.crc_end - c.part_begin), c.part_crc, member_end, trailer_crc, trailer_isize});
+    c.part_begin = c.crc_end;
+    c.part_crc   = 0;
+}
+
+void release_chunk(inflate_chunk& c)
+{
+    c.output = output_buffer{};
+    c.member_outputs.clear();
+    c.parts  = {};
+}
+
+size_t chunk_output_size(const inflate_chunk& c)
+{
+    size_t size = c.output.used();
+    for (const auto& o : c.member_outputs) {
+        size += o.used();
+    }
+    return size;
+}
+
+// Decode the chunk as far as the input before limit allows
+void advance_chunk(inflate_chunk& c, const uint8_t* limit)
+{
+    for (;;) {
+        switch (c.st) {
+        case inflate_chunk::state::header: {
+            const auto body = c.pos == limit ? nullptr : skip_gzip_header(c.pos, limit);
+            if (!body) {
+                checksum_chunk_output(c);
+                return;
+            }
+            c.st      = inflate_chunk::state::body;
+            c.pos     = body;
+            c.bits    = 0;
+            c.avail   = 0;
+            c.decoder = block_decoder{};
+            break;
+        }
+        case inflate_chunk::state::body: {
+            bit_stream bs{c.pos, limit, c.bits, c.avail};
+            auto st = c.decoder.decode(bs, c.output);
+            for (; st == block_decoder::status::need_output; st = c.decoder.decode(bs, c.output)) {
+                c.output.enlarge();
+            }
+            bs.remove_padding();
+            if (st == block_decoder::status::need_input) {
+                c.pos   = bs.position();
+                c.bits  = bs.buffered_bits();
+                c.avail = bs.available_bits();
+                checksum_chunk_output(c);
+                return;
+            }
+            // The whole input is in memory, so bytes read ahead can be found before the bit_stream's position
+            bs.align_to_byte();
+            c.st  = inflate_chunk::state::trailer;
+            c.pos = bs.position() - bs.available_bits() / 8;
+            break;
+        }
+        case inflate_chunk::state::trailer:
+            if (limit - c.pos < 8) {
+                checksum_chunk_output(c);
+                return;
+            }
+            end_chunk_part(c, true, load_le32_unaligned(c.pos), load_le32_unaligned(c.pos + 4));
+            c.member_outputs.push_back(std::move(c.output));
+            c.output     = output_buffer{};
+            c.part_begin = 0;
+            c.crc_end    = 0;
+            c.st   = inflate_chunk::state::header;
+            c.pos += 8;
+            break;
+        }
+    }
+}
+
+// Whether b can take over from a at b's start
+bool continues_at(const inflate_chunk& a, const inflate_chunk& b)
+{
+    if (b.error || a.pos != b.begin) {
+        return false;
+    }
+    if (b.member_start) {
+        return a.st == inflate_chunk::state::header;
+    }
+    return a.st == inflate_chunk::state::body && !a.avail && a.decoder.at_block_boundary();
+}
+
+std::vector<uint8_t> decompress_parallel(const uint8_t* begin, const uint8_t* end, int num_threads, int chunk_size)
+{
+    if (begin == end) {
+        throw_deflate_error(error_code::truncated);
+    }
+    if (num_threads <= 0) {
+        num_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    const auto input_size = end - begin;
+    if (chunk_size <= 0) {
+        chunk_size = static_cast<int>(std::min<ptrdiff_t>(std::max<ptrdiff_t>(1 << 20, input_size / (4 * num_threads)), 1 << 30));
+    }
+
+    // Look for the first possible chunk start in each stretch of chunk_size bytes
+    const int num_splits = static_cast<int>((input_size + chunk_size - 1) / chunk_size);
+    std::vector<const uint8_t*> split_starts(num_splits);
+    std::vector<char> split_is_member(num_splits);
+    parallel_for(num_splits - 1, num_threads, [&](int j) {
+        const int i = j + 1;
+        const auto stop = begin + std::min<ptrdiff_t>(input_size, static_cast<ptrdiff_t>(i + 1) * chunk_size);
+        auto p = begin + static_cast<ptrdiff_t>(i) * chunk_size;
+        for (; p != stop && !is_gzip_member_start(p, end) && !follows_sync_flush(p, begin); ++p) {
+        }
+        split_starts[i]    = p == stop ? nullptr : p;
+        split_is_member[i] = p != stop && is_gzip_member_start(p, end);
+    });
+
+    std::vector<inflate_chunk> chunks(1);
+    chunks.reserve(num_splits + 1);
+    chunks[0].begin        = begin;
+    chunks[0].member_start = true;
+    for (int i = 1; i < num_splits; ++i) {
+        if (split_starts[i]) {
+            chunks.emplace_back();
+            chunks.back().begin        = split_starts[i];
+            chunks.back().member_start = !!split_is_member[i];
+        }
+    }
+    for (auto& c : chunks) {
+        c.st  = c.member_start ? inflate_chunk::state::header : inflate_chunk::state::body;
+        c.pos = c.begin;
+    }
+
+    const int num_chunks = static_cast<int>(chunks.size());
+    auto chunk_limit = [&](int i) { return i + 1 < num_chunks ? chunks[i + 1].begin : end; };
+    parallel_for(num_chunks, num_threads, [&](int i) {
+        try {
+            advance_chunk(chunks[i], chunk_limit(i));
+        } catch (...) {
+            chunks[i].error = std::current_exception();
+        }
+    });
+
+    // Stitch the chunks together, checking each member's CRC-32 (combined from its parts) and size
+    std::vector<int> used_chunks;
+    std::vector<size_t> offsets;
+    size_t   output_size = 0;
+    uint32_t member_crc  = 0;
+    uint32_t member_size = 0;
+    auto finish_chunk = [&](int i) {
+        auto& c = chunks[i];
+        end_chunk_part(c, false, 0, 0);
+        for (const auto& part : c.parts) {
+            member_crc   = combine_crc32(member_crc, part.crc, part.size);
+            member_size += static_cast<uint32_t>(part.size);
+            if (part.member_end) {
+                if (part.trailer_crc != member_crc) {
+                    throw_deflate_error(error_code::crc32_mismatch);
+                }
+                if (part.trailer_isize != member_size) {
+                    throw_deflate_error(error_code::isize_mismatch);
+                }
+                member_crc  = 0;
+                member_size = 0;
+            }
+        }
+        used_chunks.push_back(i);
+        offsets.push_back(output_size);
+        output_size += chunk_output_size(c);
+    };
+
+    int cur = 0;
+    if (chunks[cur].error) {
+        std::rethrow_exception(chunks[cur].error);
+    }
+    for (int i = 1; i < num_chunks; ++i) {
+        if (continues_at(chunks[cur], chunks[i])) {
+            finish_chunk(cur);
+            cur = i;
+        } else {
+            // Not actually a boundary, or depending on earlier output
+            advance_chunk(chunks[cur], chunk_limit(i));
+            release_chunk(chunks[i]);
+        }
+    }
+    if (chunks[cur].st != inflate_chunk::state::header || chunks[cur].pos != end) {
+        throw_deflate_error(error_code::truncated);
+    }
+    finish_chunk(cur);
+
+    std::vector<uint8_t> output(output_size);
+    parallel_for(static_cast<int>(used_chunks.size()), num_threads, [&](int i) {
+        auto& c = chunks[used_chunks[i]];
+        auto dst = output.data() + offsets[i];
+        auto append = [&dst](const output_buffer& o) {
+            if (o.used()) {
+                memcpy(dst, o.data(), o.used());
+                dst += o.used();
+            }
+        };
+        for (const auto& o : c.member_outputs) {
+            append(o);
+        }
+        append(c.output);
+        release_chunk(c);
+    });
+    return output;
+}
+
+} // namespace deflate
@@ -0,0 +1,29 @@
+#ifndef DEFLATE_PARALLEL_INFLATE_H
+#define DEFLATE_PARALLEL_INFLATE_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace deflate {
+
+// Decompress a complete gzip file using num_threads threads (0 for one per core).
+//
+// The input is split at gzip member headers and sync flush markers (the empty stored block zlib and pigz emit between
+// blocks) into chunks of about chunk_size bytes (0 picks a size giving each thread a few chunks) which are inflated
+// in parallel. Chunks are stitched together in order, each used only if the previous chunk ended exactly at its
+// start and it doesn't reference earlier output (as for BGZF members and pigz --independent blocks). Otherwise the
+// previous chunk continues decoding through it, so any gzip file is decoded correctly, but only files made up of
+// independent parts are decoded faster.
+// Throws std::runtime_error if the input is invalid or truncated.
+std::vector<uint8_t> decompress_parallel(const uint8_t* begin, const uint8_t* end, int num_threads = 0, int chunk_size = 0);
+
+// Returns the start of the deflate data of the gzip member at p or nullptr if the header doesn't end before end.
+// Throws std::runtime_error if there's no gzip header at p.
+const uint8_t* skip_gzip_header(const uint8_t* p, const uint8_t* end);
+
+// Little endian 32-bit value at p, as in gzip trailers
+uint32_t load_le32_unaligned(const uint8_t* p);
+
+} // namespace deflate
+
+#endif
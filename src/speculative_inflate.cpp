@@ -0,0 +1,358 @@
+#include "speculative_inflate.h"
+#include "deflate_error.h"
+#include "parallel_inflate.h"
+#include "parallel_for.h"
+#include "block_decoder.h"
+#include "bit_stream.h"
+#include "decode_table.h"
+#include "deflate.h"
+#include "deflate_alphabet.h"
+#include "output_buffer.h"
+#include "crc.h"
+
+#include <string.h>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+namespace deflate {
+
+// The speculative decoder outputs bytes (0-255) or markers, marker_base + i standing for byte i of the max_distance
+// bytes long window preceding the chunk
+constexpr int marker_base = 256;
+
+struct speculative_tables {
+    decode_table cl;
+    decode_table lit_len;
+    decode_table dist;
+};
+
+struct speculative_chunk {
+    int64_t               start_bit = -1; // First block, from the start of the deflate data
+    int64_t               end_bit   = 0;  // Block boundary decoding stopped at or the end of the final block
+    bool                  final     = false;
+    std::exception_ptr    error;
+    std::vector<uint16_t> symbols;        // max_distance window entries followed by the output
+    size_t                size      = 0;  // Number of output symbols
+    std::vector<uint8_t>  window;         // Output preceding the chunk (at most max_distance bytes)
+    uint32_t              crc       = 0;
+};
+
+bit_stream bit_stream_at(const uint8_t* data, const uint8_t* end, int64_t bit)
+{
+    bit_stream bs{data + bit / 8, end};
+    if (bit % 8) {
+        bs.get_bits(bit % 8);
+    }
+    return bs;
+}
+
+// Read the code lengths of a dynamic block (following the block header) and build its tables. Returns false if they
+// don't describe valid codes.
+bool read_dynamic_tables(bit_stream& bs, speculative_tables& t)
+{
+    const int hlit  = 257 + bs.get_bits(5);
+    const int hdist = 1 + bs.get_bits(5);
+    const int hclen = 4 + bs.get_bits(4);
+    if (hlit > len_max + 1 || hdist > num_distance_codes) {
+        return false;
+    }
+    uint8_t cl_lengths[num_code_length_codes] = {};
+    for (int i = 0; i < hclen; ++i) {
+        cl_lengths[code_length_order[i]] = static_cast<uint8_t>(bs.get_bits(3));
+    }
+    if (!t.cl.build(cl_lengths, num_code_length_codes, decode_table::alphabet::code_length, 7)) {
+        return false;
+    }
+
+    uint8_t lengths[decode_table::max_symbols + 32];
+    for (int i = 0; i < hlit + hdist;) {
+        i = decode_code_length(t.cl, bs, lengths, i, hlit + hdist);
+        if (i < 0 || bs.overrun()) {
+            return false;
+        }
+    }
+    return build_dynamic_tables(lengths, hlit, hdist, t.lit_len, t.dist);
+}
+
+// Quick check whether a non-final dynamic or stored block could start at bit
+bool plausible_block_start(const uint8_t* data, const uint8_t* end, int64_t bit, speculative_tables& t)
+{
+    auto bs = bit_stream_at(data, end, bit);
+    const auto header = bs.get_bits(3);
+    if (header == 4) {
+        return read_dynamic_tables(bs, t);
+    } else if (header == 0) {
+        const int pad = bs.available_bits() % 8;
+        if (pad && bs.get_bits(pad)) {
+            return false;
+        }
+        const auto len  = bs.get_bits(16);
+        const auto nlen = bs.get_bits(16);
+        return !bs.overrun() && len == (~nlen & 0xffff);
+    }
+    return false;
+}
+
+// Decode blocks from c.start_bit to the output following the window entries in c.symbols, until a block starts at
+// or after stop_bit or the final block has been decoded. Only the last window_valid window entries may be
+// referenced. Throws std::runtime_error on invalid or truncated input.
+void decode_speculative_chunk(const uint8_t* data, const uint8_t* end, speculative_chunk& c, int window_valid, int64_t stop_bit, speculative_tables& t)
+{
+    const int64_t base = c.start_bit / 8 * 8;
+    auto bs = bit_stream_at(data, end, c.start_bit);
+    size_t n = max_distance;
+    auto reserve = [&c](size_t size) {
+        if (c.symbols.size() < size) {
+            c.symbols.resize(std::max(size, 2 * c.symbols.size()));
+        }
+    };
+    for (bool first = true;; first = false) {
+        const int64_t block_bit = base + bs.bit_position();
+        if (!first && block_bit >= stop_bit) {
+            c.end_bit = block_bit;
+            break;
+        }
+        const auto header = bs.get_bits(3);
+        const decode_table* lit_len_table = &t.lit_len;
+        const decode_table* dist_table    = &t.dist;
+        if (header >> 1 == 0) {
+            bs.align_to_byte();
+            const auto len  = bs.get_bits(16);
+            const auto nlen = bs.get_bits(16);
+            if (bs.overrun()) {
+                throw_deflate_error(error_code::truncated);
+            }
+            if (len != (~nlen & 0xffff)) {
+                throw_deflate_error(error_code::invalid_stored_length);
+            }
+            reserve(n + len);
+            uint8_t buffer[256];
+            for (int left = static_cast<int>(len); left;) {
+                const int count = std::min(left, static_cast<int>(sizeof(buffer)));
+                if (bs.read_bytes(buffer, count) != count) {
+                    throw_deflate_error(error_code::truncated);
+                }
+                std::copy(buffer, buffer + count, c.symbols.data() + n);
+                n    += count;
+                left -= count;
+            }
+        } else {
+            if (header >> 1 == 1) {
+                lit_len_table = &fixed_lit_len_decode_table;
+                dist_table    = &fixed_dist_decode_table;
+            } else if (header >> 1 != 2) {
+                throw_deflate_error(error_code::invalid_block_type);
+            } else if (!read_dynamic_tables(bs, t)) {
+                throw_deflate_error(bs.overrun() ? error_code::truncated : error_code::invalid_code_lengths);
+            }
+            for (;;) {
+                reserve(n + max_match_length);
+                uint16_t* const out = c.symbols.data();
+                bs.ensure_bits(max_sequence_bits);
+                if (bs.overrun()) {
+                    throw_deflate_error(error_code::truncated);
+                }
+                const auto e = lit_len_table->lookup(bs.peek_bits(max_bits));
+                if (e.is_literal()) {
+                    bs.consume_bits(e.code_len());
+                    out[n++] = static_cast<uint16_t>(e.value());
+                    continue;
+                }
+                if (!e.is_base()) {
+                    bs.consume_bits(e.code_len());
+                    if (e.is_end_of_block()) {
+                        break;
+                    }
+                    throw_deflate_error(error_code::invalid_symbol);
+                }
+                const int len = decode_base(e, bs);
+                const auto de = dist_table->lookup(bs.peek_bits(max_bits));
+                if (!de.is_base()) {
+                    throw_deflate_error(error_code::invalid_symbol);
+                }
+                const int dist = decode_base(de, bs);
+                if (static_cast<size_t>(dist) > n - max_distance + window_valid) {
+                    throw_deflate_error(error_code::invalid_distance);
+                }
+                // Markers are copied like bytes
+                for (int i = 0; i < len; ++i) {
+                    out[n + i] = out[n - dist + i];
+                }
+                n += len;
+            }
+        }
+        if (bs.overrun()) {
+            throw_deflate_error(error_code::truncated);
+        }
+        if (header & 1) {
+            c.final   = true;
+            c.end_bit = base + bs.bit_position();
+            break;
+        }
+    }
+    c.size = n - max_distance;
+}
+
+// Window entries for a chunk starting at a known position: the preceding output if known, otherwise markers
+void init_speculative_window(speculative_chunk& c, const std::vector<uint8_t>* window)
+{
+    c.symbols.resize(max_distance + (1 << 16));
+    for (int i = 0; i < max_distance; ++i) {
+        c.symbols[i] = static_cast<uint16_t>(marker_base + i);
+    }
+    if (window) {
+        std::copy(window->begin(), window->end(), c.symbols.begin() + max_distance - window->size());
+    }
+}
+
+// Output symbols [from, from+count) of the chunk with markers replaced by bytes of c.window
+void resolve_speculative_chunk(const speculative_chunk& c, size_t from, size_t count, uint8_t* dst)
+{
+    const size_t missing = max_distance - c.window.size();
+    const uint16_t* src = c.symbols.data() + max_distance + from;
+    for (size_t i = 0; i < count; ++i) {
+        const auto s = src[i];
+        if (s < marker_base) {
+            dst[i] = static_cast<uint8_t>(s);
+        } else if (static_cast<size_t>(s - marker_base) >= missing) {
+            dst[i] = c.window[s - marker_base - missing];
+        } else {
+            throw_deflate_error(error_code::invalid_distance); // Reference before the start of the output
+        }
+    }
+}
+
+// The (at most max_distance) bytes of output up to the end of c
+std::vector<uint8_t> window_after(const speculative_chunk& c)
+{
+    const auto from_chunk  = std::min<size_t>(c.size, max_distance);
+    const auto from_window = std::min(c.window.size(), max_distance - from_chunk);
+    std::vector<uint8_t> window(c.window.end() - from_window, c.window.end());
+    window.resize(from_window + from_chunk);
+    resolve_speculative_chunk(c, c.size - from_chunk, from_chunk, window.data() + from_window);
+    return window;
+}
+
+// Append the output of the gzip member at begin to output, returning the end of the member. Small members (and any
+// following them) are inflated sequentially.
+const uint8_t* inflate_speculative_member(const uint8_t* begin, const uint8_t* end, int num_threads, int chunk_size, std::vector<uint8_t>& output)
+{
+    const auto data = skip_gzip_header(begin, end);
+    if (!data) {
+        throw_deflate_error(error_code::truncated);
+    }
+    const int64_t data_bits = 8 * static_cast<int64_t>(end - data);
+    if (chunk_size <= 0) {
+        chunk_size = static_cast<int>(std::min<ptrdiff_t>(std::max<ptrdiff_t>(1 << 21, (end - data) / (4 * num_threads)), 1 << 30));
+    }
+    const int64_t chunk_bits = 8 * static_cast<int64_t>(chunk_size);
+    const int num_chunks = static_cast<int>((data_bits + chunk_bits - 1) / chunk_bits);
+    if (num_chunks <= 1) {
+        const auto rest = decompress(stream_format::gzip, begin, end);
+        output.insert(output.end(), rest.begin(), rest.end());
+        return end;
+    }
+    auto stop_bit = [&](int i) { return i + 1 < num_chunks ? (i + 1) * chunk_bits : data_bits; };
+
+    // Decode the first chunk and guess where a block starts in each of the others
+    std::vector<speculative_chunk> chunks(num_chunks);
+    parallel_for(num_chunks, num_threads, [&](int i) {
+        auto& c = chunks[i];
+        speculative_tables t;
+        if (i == 0) {
+            try {
+                c.start_bit = 0;
+                init_speculative_window(c, nullptr);
+                decode_speculative_chunk(data, end, c, 0, stop_bit(0), t);
+            } catch (...) {
+                c.error = std::current_exception();
+            }
+            return;
+        }
+        for (int64_t bit = i * chunk_bits; bit < stop_bit(i); ++bit) {
+            if (!plausible_block_start(data, end, bit, t)) {
+                continue;
+            }
+            try {
+                c.start_bit = bit;
+                init_speculative_window(c, nullptr);
+                decode_speculative_chunk(data, end, c, max_distance, stop_bit(i), t);
+                return;
+            } catch (const std::exception&) {
+            }
+        }
+        c = speculative_chunk{};
+    });
+
+    // Chain the chunks, decoding again from where the previous chunk ended when the guess was wrong
+    if (chunks[0].error) {
+        std::rethrow_exception(chunks[0].error);
+    }
+    std::vector<int> used_chunks{0};
+    std::vector<size_t> offsets{0};
+    speculative_tables t;
+    for (int prev = 0; !chunks[prev].final;) {
+        const auto& p = chunks[prev];
+        const int i = static_cast<int>(std::max<int64_t>(prev + 1, p.end_bit / chunk_bits));
+        if (i >= num_chunks) {
+            throw_deflate_error(error_code::truncated);
+        }
+        auto window = window_after(p);
+        auto& c = chunks[i];
+        if (c.start_bit != p.end_bit) {
+            c = speculative_chunk{};
+            c.start_bit = p.end_bit;
+            init_speculative_window(c, &window);
+            decode_speculative_chunk(data, end, c, static_cast<int>(window.size()), stop_bit(i), t);
+        }
+        c.window = std::move(window);
+        offsets.push_back(offsets.back() + p.size);
+        used_chunks.push_back(i);
+        prev = i;
+    }
+
+    // Resolve the markers and checksum each chunk
+    const auto& last = chunks[used_chunks.back()];
+    const size_t member_begin = output.size();
+    const size_t member_size = offsets.back() + last.size;
+    output.resize(member_begin + member_size);
+    parallel_for(static_cast<int>(used_chunks.size()), num_threads, [&](int i) {
+        auto& c = chunks[used_chunks[i]];
+        const auto dst = output.data() + member_begin + offsets[i];
+        resolve_speculative_chunk(c, 0, c.size, dst);
+        c.crc = update_crc32(0, dst, dst + c.size);
+        c.symbols = {};
+    });
+
+    uint32_t crc = 0;
+    for (const int i : used_chunks) {
+        crc = combine_crc32(crc, chunks[i].crc, chunks[i].size);
+    }
+    const auto trailer = data + (last.end_bit + 7) / 8;
+    if (end - trailer < 8) {
+        throw_deflate_error(error_code::truncated);
+    }
+    if (load_le32_unaligned(trailer) != crc) {
+        throw_deflate_error(error_code::crc32_mismatch);
+    }
+    if (load_le32_unaligned(trailer + 4) != static_cast<uint32_t>(member_size)) {
+        throw_deflate_error(error_code::isize_mismatch);
+    }
+    return trailer + 8;
+}
+
+std::vector<uint8_t> decompress_speculative(const uint8_t* begin, const uint8_t* end, int num_threads, int chunk_size)
+{
+    if (num_threads <= 0) {
+        num_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    std::vector<uint8_t> output;
+    do {
+        begin = inflate_speculative_member(begin, end, num_threads, chunk_size, output);
+    } while (begin != end);
+    return output;
+}
+
+} // namespace deflate
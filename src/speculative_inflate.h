@@ -0,0 +1,24 @@
+#ifndef DEFLATE_SPECULATIVE_INFLATE_H
+#define DEFLATE_SPECULATIVE_INFLATE_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace deflate {
+
+// Experimental: decompress a complete gzip file using num_threads threads (0 for one per core) even when it's a
+// single ordinary deflate stream.
+//
+// The deflate data is split into chunks of chunk_size bytes (0 picks a size giving each thread a few chunks). For
+// each chunk a worker guesses where the first dynamic or stored block after the chunk's start begins, by trying each
+// bit offset, and decodes from there until the first block starting in the next chunk. As the preceding 32 KiB of
+// output isn't known yet, references into it are decoded as markers. The chunks are then stitched together in order:
+// a chunk is used if its guessed start is where the previous chunk ended (otherwise that part is decoded again
+// sequentially) and its markers are replaced once the window ending the previous chunk is known.
+// Decoding is slower per thread than decompress() and needs about three bytes of memory per output byte.
+// Throws std::runtime_error if the input is invalid or truncated.
+std::vector<uint8_t> decompress_speculative(const uint8_t* begin, const uint8_t* end, int num_threads = 0, int chunk_size = 0);
+
+} // namespace deflate
+
+#endif